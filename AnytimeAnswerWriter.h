@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+#include "IO.h"
+#include "SolutionBoard.h"
+
+namespace sandrokottos {
+
+// SolutionBoardに公開されたソリューションを、処理の途中でも回答として出力します。途中で処理を打ち切られても、それまでの最良の回答を使えます。
+//
+//   ファイルに出力する場合: 一時ファイルに書き込んでから名前を変更するので、ファイルには常に完全な回答があります。
+//   標準出力に出力する場合（パスが"-"の場合）: 回答ごとに"ANSWER <バイト数>\n"の行を付けて、続けて回答を出力します。
+//
+// 出力はソルバーとは別のスレッドで、前回の出力から一定の時間が経過した場合にだけ実行します。SIGTERMを受け取ったら、最良の回答を出力して終了します。
+
+class AnytimeAnswerWriter final {
+  const sandrokottos::Identifiers &Identifiers;
+  const SolutionBoard &Board;
+  std::filesystem::path Path;
+
+  // 出力の最小の間隔です。
+
+  static constexpr auto Interval = std::chrono::milliseconds{200};
+
+  inline static auto IsTerminated = std::atomic<bool>{false};
+
+  std::jthread Thread;
+
+  auto write(const Solution &Solution) const noexcept {
+    if (Path == "-") {
+      auto Stream = std::ostringstream{};
+
+      writeAnswer(Stream, Identifiers, Solution);
+
+      const auto Answer = Stream.str();
+
+      std::cout << "ANSWER " << std::size(Answer) << "\n"
+                << Answer << std::flush;
+
+      return;
+    }
+
+    const auto TemporaryPath = [&] {
+      auto Result = Path;
+
+      Result += ".tmp";
+
+      return Result;
+    }();
+
+    {
+      auto Stream = std::ofstream{TemporaryPath, std::ios::binary};
+
+      writeAnswer(Stream, Identifiers, Solution);
+
+      if (!Stream) {
+        std::cerr << "CAN NOT WRITE " << TemporaryPath << "..." << std::endl;
+        return;
+      }
+    }
+
+    auto ErrorCode = std::error_code{};
+
+    std::filesystem::rename(TemporaryPath, Path, ErrorCode);
+
+    if (ErrorCode) {
+      std::cerr << "CAN NOT RENAME " << TemporaryPath << "..." << std::endl;
+    }
+  }
+
+  // 最良のソリューションを出力します。まだ公開されていない場合は、何も配送しない回答を出力します。
+
+  auto writeBest() const noexcept {
+    const auto Best = Board.get();
+
+    write(Best ? *Best : Solution{});
+  }
+
+  auto run(std::stop_token StopToken) const noexcept {
+    auto Version = 0;
+    auto WritingTime = std::chrono::steady_clock::time_point{};
+
+    while (!StopToken.stop_requested()) {
+      if (IsTerminated) {
+        writeBest();
+        std::_Exit(0);
+      }
+
+      if (Board.getVersion() != Version && std::chrono::steady_clock::now() - WritingTime >= Interval) {
+        Version = Board.getVersion();
+        WritingTime = std::chrono::steady_clock::now();
+
+        writeBest();
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+
+    // 間隔の制限で出力できなかったソリューションを出力します。
+
+    if (Board.getVersion() != Version) {
+      writeBest();
+    }
+  }
+
+public:
+  explicit AnytimeAnswerWriter(const sandrokottos::Identifiers &Identifiers, const SolutionBoard &Board, const std::filesystem::path &Path) noexcept
+      : Identifiers{Identifiers}, Board{Board}, Path{Path} {
+    std::signal(SIGTERM, [](int) {
+      IsTerminated = true;
+    });
+
+    Thread = std::jthread{[this](std::stop_token StopToken) {
+      run(StopToken);
+    }};
+  }
+
+  // スレッドを止めて、最後の出力を待ちます。
+
+  ~AnytimeAnswerWriter() {
+    Thread.request_stop();
+    Thread.join();
+  }
+};
+
+} // namespace sandrokottos
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "GenerateQuestion.h"
+#include "IO.h"
+#include "Model.h"
+#include "OptimizeOrderSize.h"
+#include "OptimizePickupAndDeliveryDuration.h"
+#include "OptimizePickupAndDeliveryDurationByTabuSearch.h"
+
+// ソルバーの処理時間の大部分を占める処理を、個別に計測します。
+// 結果は、コミットごとに比較できるように、安定した形式のJSONで標準出力に出力します。
+//
+// 使い方: sandrokottos_benchmark [data/questionsのパス] > benchmark.json
+
+namespace sandrokottos {
+
+// operator newが呼ばれた回数です。処理ごとのメモリ確保の回数を計測するために使用します。
+
+inline auto AllocationCount = std::atomic<std::int64_t>{0};
+
+class Benchmark final {
+  std::vector<nlohmann::json> Results;
+
+  // 最適化で処理が消されないように、結果を書き込む先です。
+
+  inline static volatile std::int64_t Sink = 0;
+
+  // 最低でも0.2秒かつ10回、処理を繰り返して計測します。
+
+  template <typename F>
+  auto measure(const std::string &Name, const std::string &Input, F &&Function) {
+    Function(); // ウォーム・アップ。
+
+    auto Iterations = std::int64_t{0};
+    auto Duration = std::chrono::nanoseconds{0};
+
+    const auto StartingAllocationCount = AllocationCount.load();
+
+    for (auto BatchSize = std::int64_t{1}; Duration < std::chrono::milliseconds{200} || Iterations < 10; BatchSize *= 2) {
+      const auto StartingTime = std::chrono::steady_clock::now();
+
+      for (auto I = std::int64_t{0}; I < BatchSize; ++I) {
+        Sink = Sink + static_cast<std::int64_t>(Function());
+      }
+
+      Duration += std::chrono::steady_clock::now() - StartingTime;
+      Iterations += BatchSize;
+    }
+
+    const auto AllocationsPerOp = static_cast<double>(AllocationCount.load() - StartingAllocationCount) / static_cast<double>(Iterations);
+
+    Results.emplace_back(nlohmann::json::object({{"name", Name},
+                                                 {"input", Input},
+                                                 {"iterations", Iterations},
+                                                 {"ns_per_op", static_cast<double>(Duration.count()) / static_cast<double>(Iterations)},
+                                                 {"allocations_per_op", AllocationsPerOp}}));
+
+    std::cerr << Name << "\t" << Input << "\t" << static_cast<double>(Duration.count()) / static_cast<double>(Iterations) << " ns/op\t" << AllocationsPerOp << " allocs/op" << std::endl;
+  }
+
+  // 希望配送時間の終わりが早い順に注文を並べて、4件ずつ積み込んでから配送する経路を作成します。
+
+  static auto createRoute(const Problem &Problem, int OrderSize) {
+    const auto Orders = [&] {
+      auto Result = std::vector<int>{};
+
+      std::ranges::copy(std::views::iota(0, std::min(OrderSize, Problem.getOrderSize())), std::back_inserter(Result));
+
+      std::ranges::sort(Result, [&](const auto &Order1, const auto &Order2) {
+        return std::get<1>(Problem.getTimeWindows()[Order1]) < std::get<1>(Problem.getTimeWindows()[Order2]);
+      });
+
+      return Result;
+    }();
+
+    auto Result = Route{};
+
+    for (auto I = 0; I < static_cast<int>(std::size(Orders)); I += 4) {
+      for (auto J = I; J < std::min(I + 4, static_cast<int>(std::size(Orders))); ++J) {
+        Result.emplace_back(Orders[J] * 2 + 0);
+      }
+
+      for (auto J = I; J < std::min(I + 4, static_cast<int>(std::size(Orders))); ++J) {
+        Result.emplace_back(Orders[J] * 2 + 1);
+      }
+    }
+
+    return Result;
+  }
+
+  // ロボットごとに、順番に注文を割り当てたソリューションを作成します。
+
+  static auto createSolution(const Problem &Problem) {
+    auto Routes = std::vector<Route>(Problem.getRobotSize());
+
+    for (auto I = 0; I < Problem.getOrderSize(); I += 4) {
+      auto &Route = Routes[I / 4 % Problem.getRobotSize()];
+
+      for (auto J = I; J < std::min(I + 4, Problem.getOrderSize()); ++J) {
+        Route.emplace_back(J * 2 + 0);
+      }
+
+      for (auto J = I; J < std::min(I + 4, Problem.getOrderSize()); ++J) {
+        Route.emplace_back(J * 2 + 1);
+      }
+    }
+
+    auto Timetables = std::vector<Timetable>{};
+
+    std::ranges::copy(
+        Routes | std::views::transform([&](const auto &Route) {
+          return CreateEarliestTimetable{Problem}(Route);
+        }),
+        std::back_inserter(Timetables));
+
+    return std::make_tuple(Routes, Timetables);
+  }
+
+  auto runProblem(const std::string &Input, const nlohmann::json &Question) {
+    measure("convertToProblem", Input, [&] {
+      return convertToProblem(Question).getOrderSize();
+    });
+
+    // JSONを読み込みながら変換する場合の、読み込みから問題の作成までです。
+
+    const auto Text = Question.dump();
+
+    measure("readProblem", Input, [&] {
+      auto Stream = std::istringstream{Text};
+
+      return std::get<0>(*readProblem(Stream)).getOrderSize();
+    });
+
+    const auto Problem = convertToProblem(Question);
+
+    // 最もキャパシティーが大きいロボットで計測します。
+
+    const auto RIndex = static_cast<int>(std::distance(std::begin(Problem.getCapacities()), std::ranges::max_element(Problem.getCapacities())));
+    const auto Capacity = Problem.getCapacities()[RIndex];
+
+    for (const auto &OrderSize : {4, 8, 16, 30}) {
+      if (OrderSize > Problem.getOrderSize()) {
+        continue;
+      }
+
+      const auto RouteInput = Input + "/route" + std::to_string(OrderSize);
+
+      const auto Route = createRoute(Problem, OrderSize);
+      const auto Timetable = CreateEarliestTimetable{Problem}(Route);
+
+      const auto OrderSizeOptimizer = OptimizeOrderSize{Problem};
+      const auto NewOrder = OrderSize < Problem.getOrderSize() ? OrderSize : 0;
+
+      auto NewRoute = sandrokottos::Route{};
+      auto NewTimetable = sandrokottos::Timetable{};
+
+      measure("getInsertedRoute", RouteInput, [&] {
+        getInsertedRoute(Route, NewOrder, static_cast<int>(std::size(Route) / 2), static_cast<int>(std::size(Route) / 2) + 2, NewRoute);
+
+        return std::size(NewRoute);
+      });
+
+      measure("OptimizeOrderSize::getNewTimetable", RouteInput, [&] {
+        return OrderSizeOptimizer.getNewTimetable(Route, RIndex, NewTimetable);
+      });
+
+      measure("CalculateRouteCost<AllScores>", RouteInput, [&] {
+        return std::get<0>(CalculateRouteCost<AllScores>{Problem}(Route, Timetable));
+      });
+
+      const auto States = CalculateRouteCost<AllScores>{Problem}.getStates(Route, Timetable);
+
+      measure("CalculateRouteCost<AllScores>/incremental", RouteInput, [&] {
+        return std::get<0>(CalculateRouteCost<AllScores>{Problem}(States[std::size(Route) / 2], Route, Timetable, static_cast<int>(std::size(Route) / 2)));
+      });
+
+      measure("CalculateRouteCost<DurationScores>", RouteInput, [&] {
+        return std::get<0>(CalculateRouteCost<DurationScores>{Problem}(Route, Timetable));
+      });
+
+      const auto DurationOptimizer = OptimizePickupAndDeliveryDuration{Problem};
+      auto RandomNumberGenerator = std::minstd_rand{0};
+
+      measure("OptimizePickupAndDeliveryDuration::getNeighborRoute", RouteInput, [&] {
+        DurationOptimizer.getNeighborRoute(Route, RandomNumberGenerator, NewRoute);
+
+        return std::size(NewRoute);
+      });
+
+      measure("OptimizePickupAndDeliveryDuration::isValidRoute", RouteInput, [&] {
+        return DurationOptimizer.isValidRoute(Capacity, Route);
+      });
+
+      const auto TabuSearchOptimizer = OptimizePickupAndDeliveryDurationByTabuSearch{Problem};
+
+      measure("OptimizePickupAndDeliveryDurationByTabuSearch::getProxyTimetable", RouteInput, [&] {
+        return TabuSearchOptimizer.getProxyTimetable(Route, Capacity, NewTimetable);
+      });
+
+      const auto Deadline = std::chrono::steady_clock::time_point::max();
+
+      measure("CreateStrictTimetable", RouteInput, [&] {
+        return std::size(CreateStrictTimetable{Problem, Deadline}(Route));
+      });
+
+      measure("CreateRelaxedTimetable", RouteInput, [&] {
+        return std::size(CreateRelaxedTimetable{Problem, Deadline}(Route));
+      });
+
+      // 近傍の経路のタイムテーブルを、元の経路のタイムテーブルをヒントにして作成します。
+
+      DurationOptimizer.getNeighborRoute(Route, RandomNumberGenerator, NewRoute);
+
+      const auto StrictTimetable = CreateStrictTimetable{Problem, Deadline}(Route);
+
+      measure("CreateStrictTimetable/neighbor", RouteInput, [&] {
+        return std::size(CreateStrictTimetable{Problem, Deadline}(NewRoute));
+      });
+
+      measure("CreateStrictTimetable/neighbor-hinted", RouteInput, [&] {
+        return std::size(CreateStrictTimetable{Problem, Deadline}(NewRoute, getMappedTimetable(Route, StrictTimetable, NewRoute)));
+      });
+    }
+
+    const auto [Routes, Timetables] = createSolution(Problem);
+
+    measure("CalculateCost", Input, [&] {
+      return std::get<0>(CalculateCost{Problem}(Routes, Timetables));
+    });
+
+    // 1つの経路を変更した後の、全体のコストの更新です。CalculateCostと比較します。
+
+    auto Working = WorkingSolution{Problem, Solution{Routes, Timetables, CalculateCost{Problem}(Routes, Timetables)}};
+
+    measure("WorkingSolution::getCost/one-route-changed", Input, [&] {
+      Working.setTimetable(0, Timetables[0]);
+
+      return std::get<0>(Working.getCost());
+    });
+  }
+
+public:
+  auto operator()(const std::filesystem::path &QuestionsPath) {
+    // data/questionsから取り出した問題です。
+
+    for (const auto &Name : {"question2-003.json", "question2-007.json", "question2-016.json", "question2-990.json"}) {
+      auto Stream = std::ifstream{QuestionsPath / Name};
+
+      if (!Stream) {
+        std::cerr << "CAN NOT OPEN " << Name << "..." << std::endl;
+        continue;
+      }
+
+      runProblem(Name, readQuestion(Stream));
+    }
+
+    // 規模を変えて合成した問題です。注文の数の上限は、convertToProblemと同じ2,000です。
+
+    for (const auto &OrderSize : {250, 500, 1'000, 2'000}) {
+      runProblem("synthetic-" + std::to_string(OrderSize), GenerateQuestion{QuestionParameters{.OrderSize = OrderSize}}());
+    }
+
+    // 住所が集中していて、キャパシティーが異なるロボットが混ざった問題です。
+
+    runProblem("synthetic-hotspot-1000", GenerateQuestion{QuestionParameters{.Capacities = {{10, 1}, {30, 2}}, .OrderSize = 1'000, .HotspotSize = 8}}());
+
+    return nlohmann::json::object({{"version", 2}, {"benchmarks", Results}});
+  }
+};
+
+} // namespace sandrokottos
+
+// メモリの確保を数えるために、operator newとoperator deleteを置き換えます。
+
+void *operator new(std::size_t Size) {
+  sandrokottos::AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+  if (const auto Result = std::malloc(Size == 0 ? 1 : Size)) {
+    return Result;
+  }
+
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *Pointer) noexcept {
+  std::free(Pointer);
+}
+
+void operator delete(void *Pointer, std::size_t) noexcept {
+  std::free(Pointer);
+}
+
+int main(int ArgCount, char **ArgValues) {
+  const auto QuestionsPath = std::filesystem::path{ArgCount >= 2 ? ArgValues[1] : "data/questions"};
+
+  std::cout << sandrokottos::Benchmark{}(QuestionsPath).dump(2) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <ranges>
+#include <tuple>
+#include <vector>
+
+#include "Model.h"
+
+namespace sandrokottos {
+
+// (-Score1, Score2, Score3)の辞書式の下界を計算します。現在の解がこの下界と等しければ、それ以上は改善できません。
+//
+//   Score1: 注文ごとに、時刻0に積み込んで直接配送した場合のスコア（それより早くは配送できません）の合計です。
+//           1台のロボットが13:00の2分前までに配送できる注文の数には上限があるので、その上限を超える分は除きます。
+//   Score2: Score1が下界と等しいなら、スコアが0より大きい注文はすべて配送済みです。その注文ごとの、積み込みから配送までの移動時間の合計です。
+//   Score3: 配送する注文のノードごとの、入ってくる辺の最短距離の合計です。経路の最初のノードには辺が入ってこないので、大きい方からロボットの台数分を除きます。
+
+class CalculateLowerBound final {
+  const sandrokottos::Problem &Problem;
+
+  // ノードごとの、入ってくる辺の最小の重みです。辺の始点の候補は、指定したノードだけです。
+
+  auto getMinWeights(const std::vector<int> &Nodes, const Matrix &Matrix) const noexcept {
+    auto Result = std::vector<int>{};
+
+    for (const auto &To : Nodes) {
+      auto Weight = std::numeric_limits<int>::max();
+
+      for (const auto &From : Nodes) {
+        if (From == To || (From % 2 != 0 && From == To + 1)) { // 配送してから、その注文を積み込むことはできません。
+          continue;
+        }
+
+        Weight = std::min(Weight, Matrix[From][To]);
+      }
+
+      Result.emplace_back(Weight == std::numeric_limits<int>::max() ? 0 : Weight);
+    }
+
+    return Result;
+  }
+
+public:
+  explicit CalculateLowerBound(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
+
+  // 注文ごとの、獲得できるスコアの最大値です。
+
+  auto getMaxScore1s() const noexcept {
+    auto Result = std::vector<int>(Problem.getOrderSize());
+
+    if (std::ranges::all_of(Problem.getCapacities(), [](const auto &Capacity) { return Capacity <= 0; })) {
+      return Result;
+    }
+
+    for (const auto &I : std::views::iota(0, Problem.getOrderSize())) {
+      const auto Minute = std::max(Problem.getDurationMatrix()[I * 2 + 0][I * 2 + 1], 30);
+
+      if (Minute > 150 - 2) {
+        continue;
+      }
+
+      Result[I] = Minute <= std::get<1>(Problem.getTimeWindows()[I]) ? 100 : Problem.getScore1(I * 2 + 1, Minute);
+    }
+
+    return Result;
+  }
+
+  // ノードごとの、入ってくる辺の最短距離です。辺の始点の候補は、指定したノードだけです。
+
+  auto getMinDistances(const std::vector<int> &Nodes) const noexcept {
+    return getMinWeights(Nodes, Problem.getDistanceMatrix());
+  }
+
+  // ノードごとの、入ってくる辺の最短の移動時間です。辺の始点の候補は、指定したノードだけです。
+
+  auto getMinDurations(const std::vector<int> &Nodes) const noexcept {
+    return getMinWeights(Nodes, Problem.getDurationMatrix());
+  }
+
+  auto operator()() const noexcept {
+    const auto MaxScore1s = getMaxScore1s();
+
+    // 配送できる注文の数の上限です。ノード間の移動には積み込みや配送の時間を含めて2分以上かかるので、1台あたり(148 / 2 + 1) / 2件までしか配送できません。
+
+    const auto MaxOrderSize = Problem.getRobotSize() * ((150 - 2) / 2 + 1) / 2;
+
+    const auto Score1 = [&] {
+      auto Scores = MaxScore1s;
+
+      std::ranges::sort(Scores, std::greater<>{});
+
+      auto Result = 0;
+
+      for (const auto &Score : Scores | std::views::take(MaxOrderSize)) {
+        Result += Score;
+      }
+
+      return Result;
+    }();
+
+    const auto Orders = [&] {
+      auto Result = std::vector<int>{};
+
+      std::ranges::copy(
+          std::views::iota(0, Problem.getOrderSize()) | std::views::filter([&](const auto &I) {
+            return MaxScore1s[I] > 0;
+          }),
+          std::back_inserter(Result));
+
+      return Result;
+    }();
+
+    // 配送できる注文の数の上限を超える場合は、どの注文を配送するのかが決まらないので、Score2とScore3の下界は0にします。
+
+    if (static_cast<int>(std::size(Orders)) > MaxOrderSize) {
+      return std::make_tuple(-Score1, 0, 0);
+    }
+
+    const auto Score2 = [&] {
+      auto Result = 0;
+
+      for (const auto &I : Orders) {
+        Result += Problem.getDurationMatrix()[I * 2 + 0][I * 2 + 1] - 2;
+      }
+
+      return Result;
+    }();
+
+    const auto Score3 = [&] {
+      const auto Nodes = [&] {
+        auto Result = std::vector<int>{};
+
+        for (const auto &I : Orders) {
+          Result.emplace_back(I * 2 + 0);
+          Result.emplace_back(I * 2 + 1);
+        }
+
+        return Result;
+      }();
+
+      auto Distances = getMinDistances(Nodes);
+
+      std::ranges::sort(Distances);
+
+      auto Result = 0;
+
+      for (const auto &Distance : Distances | std::views::take(std::max(static_cast<int>(std::size(Distances)) - Problem.getRobotSize(), 0))) {
+        Result += Distance;
+      }
+
+      return Result;
+    }();
+
+    return std::make_tuple(-Score1, Score2, Score3);
+  }
+};
+
+} // namespace sandrokottos
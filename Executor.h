@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sandrokottos {
+
+// プロセス全体で共有する、ワーク・スティーリングのタスクの実行器です。ワーカーの数は、コアの数です。
+// ワーカーごとにタスクのキューを持って、自分のキューの後ろから取り出して、自分のキューが空なら他のワーカーのキューの前から盗みます。
+// 完了を待つスレッドは、待っている間に短いタスクを実行するので、タスクの中で別のタスクを待ってもコアが遊びません。
+//
+//   submit: 短いタスクです。締め切りを指定した場合は、締め切りまでに開始できなかったタスクを実行せずにキャンセルします。
+//   launch: OR-Toolsの探索のような、制限時間まで続く長いタスクです。ワーカーで実行するとコアの数が少ない場合に他の長いタスクが制限時間まで始まらないので、タスクごとに専用のスレッドで実行します。
+
+class Executor final {
+  using Item = std::function<void()>;
+
+  struct Queue final {
+    std::mutex Mutex;
+    std::deque<Item> Items;
+  };
+
+  std::vector<std::unique_ptr<Queue>> Queues;
+  std::atomic<int> ItemSize;
+  std::atomic<unsigned int> QueueIndex;
+
+  std::mutex Mutex;
+  std::condition_variable_any ConditionVariable;
+
+  std::vector<std::jthread> Threads;
+
+  // 長いタスクのスレッドです。ワーカーより先に終了を待つように、ワーカーの後に宣言します。
+
+  std::mutex LongThreadsMutex;
+  std::vector<std::jthread> LongThreads;
+
+  // ワーカーのインデックスです。ワーカー以外のスレッドでは-1です。
+
+  inline static thread_local auto WorkerIndex = -1;
+
+  auto push(Item &&Item) noexcept {
+    auto &Queue = *Queues[WorkerIndex >= 0 ? WorkerIndex : QueueIndex++ % std::size(Queues)];
+
+    {
+      const auto Lock = std::scoped_lock{Queue.Mutex};
+
+      Queue.Items.emplace_back(std::move(Item));
+    }
+
+    ItemSize++;
+
+    {
+      const auto Lock = std::scoped_lock{Mutex};
+    }
+
+    ConditionVariable.notify_one();
+  }
+
+  // タスクを取り出します。自分のキューは後ろから、他のワーカーのキューは前から探します。
+
+  auto pop() noexcept -> std::optional<Item> {
+    if (ItemSize == 0) {
+      return std::nullopt;
+    }
+
+    const auto Size = static_cast<int>(std::size(Queues));
+    const auto Start = WorkerIndex >= 0 ? WorkerIndex : 0;
+
+    for (const auto &I : std::views::iota(0, Size)) {
+      auto &Queue = *Queues[(Start + I) % Size];
+
+      const auto Lock = std::scoped_lock{Queue.Mutex};
+
+      if (Queue.Items.empty()) {
+        continue;
+      }
+
+      auto Result = [&] {
+        if (I == 0 && WorkerIndex >= 0) {
+          auto Result = std::move(Queue.Items.back());
+          Queue.Items.pop_back();
+
+          return Result;
+        }
+
+        auto Result = std::move(Queue.Items.front());
+        Queue.Items.pop_front();
+
+        return Result;
+      }();
+
+      ItemSize--;
+
+      return Result;
+    }
+
+    return std::nullopt;
+  }
+
+  auto run(int Index, std::stop_token StopToken) noexcept {
+    WorkerIndex = Index;
+
+    while (!StopToken.stop_requested()) {
+      if (auto Item = pop()) {
+        (*Item)();
+        continue;
+      }
+
+      auto Lock = std::unique_lock{Mutex};
+
+      ConditionVariable.wait(Lock, StopToken, [&] {
+        return ItemSize > 0;
+      });
+    }
+  }
+
+  template <typename F>
+  auto push(F &&Function) noexcept {
+    using Result = std::invoke_result_t<F>;
+
+    auto Task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(Function));
+    auto Future = Task->get_future();
+
+    push(Item{[Task] { (*Task)(); }});
+
+    return Future;
+  }
+
+public:
+  explicit Executor(int WorkerSize = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u))) noexcept : ItemSize{0}, QueueIndex{0} {
+    std::ranges::generate_n(std::back_inserter(Queues), WorkerSize, [] {
+      return std::make_unique<Queue>();
+    });
+
+    for (const auto &I : std::views::iota(0, WorkerSize)) {
+      Threads.emplace_back([this, I](std::stop_token StopToken) {
+        run(I, StopToken);
+      });
+    }
+  }
+
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  ~Executor() {
+    for (auto &Thread : Threads) {
+      Thread.request_stop();
+    }
+
+    ConditionVariable.notify_all();
+  }
+
+  auto getWorkerSize() const noexcept {
+    return static_cast<int>(std::size(Threads));
+  }
+
+  // 短いタスクを1つ実行します。実行するタスクがなかった場合は、falseをリターンします。
+
+  auto help() noexcept {
+    if (auto Item = pop()) {
+      (*Item)();
+      return true;
+    }
+
+    return false;
+  }
+
+  // 待っている間は短いタスクを実行しながら、タスクの完了を待ちます。
+
+  template <typename T>
+  auto get(T &Future) noexcept {
+    while (Future.wait_for(std::chrono::seconds{0}) != std::future_status::ready) {
+      if (!help()) {
+        Future.wait_for(std::chrono::microseconds{100});
+      }
+    }
+
+    return Future.get();
+  }
+
+  template <typename F>
+  auto submit(F &&Function) noexcept {
+    return push(std::forward<F>(Function));
+  }
+
+  // 締め切りまでに開始できなかった場合は、実行せずにstd::nulloptにします。
+
+  template <typename F>
+  auto submit(F &&Function, const std::chrono::steady_clock::time_point &Deadline) noexcept {
+    return push(
+        [Function = std::forward<F>(Function), Deadline]() mutable -> std::optional<std::invoke_result_t<F>> {
+          if (std::chrono::steady_clock::now() >= Deadline) {
+            return std::nullopt;
+          }
+
+          return Function();
+        });
+  }
+
+  // 長いタスクのスレッドはワーカーではないので、その中でsubmitしたタスクはワーカーのキューに入り、待っている間は短いタスクを実行します。
+
+  template <typename F>
+  auto launch(F &&Function) noexcept {
+    using Result = std::invoke_result_t<F>;
+
+    auto Task = std::packaged_task<Result()>{std::forward<F>(Function)};
+    auto Future = Task.get_future();
+
+    const auto Lock = std::scoped_lock{LongThreadsMutex};
+
+    LongThreads.emplace_back([Task = std::move(Task)]() mutable {
+      Task();
+    });
+
+    return Future;
+  }
+
+  // Function(0)〜Function(Size - 1)を並列に実行して、完了を待ちます。戻り値がある場合は、インデックスの順に並べてリターンします。
+
+  template <typename F>
+  auto map(int Size, F &&Function) noexcept {
+    using Result = std::invoke_result_t<F, int>;
+
+    auto Futures = std::vector<std::future<Result>>{};
+
+    for (const auto &I : std::views::iota(0, Size)) {
+      Futures.emplace_back(submit([&Function, I] {
+        return Function(I);
+      }));
+    }
+
+    if constexpr (std::is_void_v<Result>) {
+      for (auto &Future : Futures) {
+        get(Future);
+      }
+    } else {
+      auto Results = std::vector<Result>{};
+
+      for (auto &Future : Futures) {
+        Results.emplace_back(get(Future));
+      }
+
+      return Results;
+    }
+  }
+
+  // ワーカーごとの作業領域です。タスクは途中でワーカーを移らないので、同じワーカーのタスクの間で使い回せます。
+  // ただし、作業領域を使っている間にタスクを待つと、待っている間に実行したタスクが同じ作業領域を使うので、待ってはなりません。
+
+  template <typename T>
+  static auto &getScratch() noexcept {
+    thread_local auto Result = T{};
+
+    return Result;
+  }
+};
+
+// プロセス全体で共有する実行器です。
+
+inline auto &getExecutor() noexcept {
+  static auto Result = Executor{};
+
+  return Result;
+}
+
+} // namespace sandrokottos
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <tuple>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace sandrokottos {
+
+// 合成する問題のパラメーターです。既定値は、extra/generate_question.pyと同じ分布（注文の数以外）です。
+
+struct QuestionParameters final {
+  int RobotSize = 350;
+  std::vector<std::tuple<int, int>> Capacities = {{30, 1}}; // (キャパシティー, 重み)の組です。重みに比例して、ロボットのキャパシティーを選びます。
+  int OrderSize = 32'768;
+  int HotspotSize = 0;    // 住所を集中させる地点の数です。0の場合は、一様に分布させます。
+  int HotspotRadius = 10; // 地点からの距離の最大値です。
+  int MinWindowWidth = 30;
+  int MaxWindowWidth = 120;
+  unsigned int Seed = 0;
+};
+
+// 問題を合成します。同じパラメーターなら、同じ問題を作成します。
+// std::uniform_int_distributionやstd::discrete_distributionの結果は標準ライブラリの実装ごとに異なるので、mt19937（出力は規格で決まっています）の出力を明示的な式で範囲に写します。
+// だから、コンパイラーが異なっても同じ問題になって、ベンチマークの結果を比較できます。ただし、generate_question.py（Pythonのrandom）と同じ問題にはなりません。
+
+class GenerateQuestion final {
+  QuestionParameters Parameters;
+
+public:
+  explicit GenerateQuestion(const QuestionParameters &Parameters) noexcept : Parameters{Parameters} {}
+
+  auto operator()() const noexcept {
+    auto RandomNumberGenerator = std::mt19937{Parameters.Seed};
+
+    // Min〜Maxの整数を、偏りがないように棄却法で作成します。
+
+    const auto Random = [&](int Min, int Max) {
+      const auto Range = static_cast<std::uint64_t>(static_cast<std::int64_t>(Max) - Min + 1);
+      const auto Limit = (std::uint64_t{1} << 32) / Range * Range;
+
+      for (;;) {
+        if (const auto Value = static_cast<std::uint64_t>(RandomNumberGenerator()); Value < Limit) {
+          return static_cast<int>(Min + static_cast<std::int64_t>(Value % Range));
+        }
+      }
+    };
+
+    const auto MinuteToOClock = [](int Minute) {
+      return Minute / 60 * 100 + Minute % 60;
+    };
+
+    auto Result = nlohmann::json{};
+
+    // ロボットです。キャパシティーが1種類の場合は、乱数を使いません。
+
+    Result["robots"] = nlohmann::json::array();
+
+    {
+      // 重みの累積和です。0〜合計-1の乱数を超える最初の累積和の、キャパシティーを選びます。
+
+      const auto CumulativeWeights = [&] {
+        auto Result = std::vector<int>{};
+
+        std::transform_inclusive_scan(
+            std::begin(Parameters.Capacities), std::end(Parameters.Capacities), std::back_inserter(Result), std::plus<>{}, [](const auto &Capacity) {
+              return std::get<1>(Capacity);
+            });
+
+        return Result;
+      }();
+
+      const auto getIndex = [&] {
+        const auto Value = Random(0, CumulativeWeights.back() - 1);
+
+        return static_cast<int>(std::distance(std::begin(CumulativeWeights), std::ranges::upper_bound(CumulativeWeights, Value)));
+      };
+
+      for (const auto &I : std::views::iota(0, Parameters.RobotSize)) {
+        const auto Capacity = std::get<0>(Parameters.Capacities[std::size(Parameters.Capacities) == 1 ? 0 : getIndex()]);
+
+        Result["robots"].push_back({{"id", I}, {"capacity", Capacity}});
+      }
+    }
+
+    // 住所を集中させる地点です。
+
+    const auto Hotspots = [&] {
+      auto Result = std::vector<std::tuple<int, int>>{};
+
+      for (auto I = 0; I < Parameters.HotspotSize; ++I) {
+        Result.emplace_back(Random(0, 150), Random(0, 150));
+      }
+
+      return Result;
+    }();
+
+    const auto Address = [&] {
+      if (Hotspots.empty()) {
+        const auto X = Random(0, 150);
+        const auto Y = Random(0, 150);
+
+        return std::vector<int>{X, Y};
+      }
+
+      const auto &[X, Y] = Hotspots[Random(0, static_cast<int>(std::size(Hotspots)) - 1)];
+
+      const auto DX = Random(-Parameters.HotspotRadius, Parameters.HotspotRadius);
+      const auto DY = Random(-Parameters.HotspotRadius, Parameters.HotspotRadius);
+
+      return std::vector<int>{std::clamp(X + DX, 0, 150), std::clamp(Y + DY, 0, 150)};
+    };
+
+    // 注文です。
+
+    Result["orders"] = nlohmann::json::array();
+
+    for (const auto &I : std::views::iota(0, Parameters.OrderSize)) {
+      const auto RAddress = Address();
+      const auto UAddress = Address();
+      const auto StartMinute = Random(11 * 60, 12 * 60 + 30);
+      const auto EndMinute = Random(std::min(StartMinute + Parameters.MinWindowWidth, 13 * 60), std::min(StartMinute + std::max(Parameters.MaxWindowWidth, Parameters.MinWindowWidth), 13 * 60));
+
+      Result["orders"].push_back({{"id", I}, {"r_address", RAddress}, {"u_address", UAddress}, {"start_time", MinuteToOClock(StartMinute)}, {"end_time", MinuteToOClock(EndMinute)}});
+    }
+
+    return Result;
+  }
+};
+
+} // namespace sandrokottos
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "GenerateQuestion.h"
+
+// 規模や分布を指定して問題を合成して、JSONで標準出力に出力します。
+//
+// 使い方: sandrokottos_generator [--robots 350] [--capacities 30:1,10:2] [--orders 32768] [--hotspots 0] [--hotspot-radius 10]
+//                                [--min-window 30] [--max-window 120] [--seed 0] > question.json
+//
+//   --capacities: キャパシティー:重みを、カンマで区切って指定します。重みに比例して、ロボットのキャパシティーを選びます。重みは0以上で、合計は1以上でなければなりません。
+//   --hotspots:   住所を集中させる地点の数です。0の場合は、一様に分布させます。
+//   --min-window, --max-window: 希望配送時間の幅（分）の範囲です。
+//
+// 不正な値（負の値など）を指定した場合は、使い方を出力して終了します。
+
+namespace {
+
+auto parseInt(std::string_view String, int &Value) noexcept {
+  const auto [Pointer, ErrorCode] = std::from_chars(std::data(String), std::data(String) + std::size(String), Value);
+
+  return ErrorCode == std::errc{} && Pointer == std::data(String) + std::size(String);
+}
+
+// 負の値を指定できない引数です。
+
+auto parseNonNegativeInt(std::string_view String, int &Value) noexcept {
+  return parseInt(String, Value) && Value >= 0;
+}
+
+auto parseCapacities(std::string_view String, std::vector<std::tuple<int, int>> &Capacities) noexcept {
+  Capacities.clear();
+
+  // 重みは負にできず、合計は1以上で、intに収まらなければなりません。
+
+  auto TotalWeight = std::int64_t{0};
+
+  while (!String.empty()) {
+    const auto Item = String.substr(0, String.find(','));
+
+    String.remove_prefix(std::min(std::size(Item) + 1, std::size(String)));
+
+    const auto Separator = Item.find(':');
+
+    auto Capacity = 0;
+    auto Weight = 1;
+
+    if (!parseNonNegativeInt(Item.substr(0, Separator), Capacity) || (Separator != std::string_view::npos && !parseNonNegativeInt(Item.substr(Separator + 1), Weight))) {
+      return false;
+    }
+
+    if ((TotalWeight += Weight) > std::numeric_limits<int>::max()) {
+      return false;
+    }
+
+    Capacities.emplace_back(Capacity, Weight);
+  }
+
+  return !Capacities.empty() && TotalWeight > 0;
+}
+
+auto printUsage() noexcept {
+  std::cerr << "USAGE: sandrokottos_generator [--robots 350] [--capacities 30:1,10:2] [--orders 32768] [--hotspots 0] [--hotspot-radius 10]" << std::endl;
+  std::cerr << "                              [--min-window 30] [--max-window 120] [--seed 0] > question.json" << std::endl;
+}
+
+} // namespace
+
+int main(int ArgCount, char **ArgValues) {
+  auto Parameters = sandrokottos::QuestionParameters{};
+
+  for (auto I = 1; I < ArgCount; I += 2) {
+    const auto Name = std::string_view{ArgValues[I]};
+
+    // 値のないオプションは、黙って無視せずにエラーにします。
+
+    if (I + 1 >= ArgCount) {
+      std::cerr << "MISSING VALUE FOR " << Name << "..." << std::endl;
+      printUsage();
+      return 1;
+    }
+
+    const auto Value = std::string_view{ArgValues[I + 1]};
+
+    const auto IsValid = [&] {
+      if (Name == "--robots") {
+        return parseNonNegativeInt(Value, Parameters.RobotSize);
+      } else if (Name == "--capacities") {
+        return parseCapacities(Value, Parameters.Capacities);
+      } else if (Name == "--orders") {
+        return parseNonNegativeInt(Value, Parameters.OrderSize);
+      } else if (Name == "--hotspots") {
+        return parseNonNegativeInt(Value, Parameters.HotspotSize);
+      } else if (Name == "--hotspot-radius") {
+        return parseNonNegativeInt(Value, Parameters.HotspotRadius);
+      } else if (Name == "--min-window") {
+        return parseNonNegativeInt(Value, Parameters.MinWindowWidth);
+      } else if (Name == "--max-window") {
+        return parseNonNegativeInt(Value, Parameters.MaxWindowWidth);
+      } else if (Name == "--seed") {
+        auto Seed = 0;
+
+        if (!parseInt(Value, Seed)) {
+          return false;
+        }
+
+        Parameters.Seed = static_cast<unsigned int>(Seed);
+
+        return true;
+      }
+
+      return false;
+    }();
+
+    if (!IsValid) {
+      std::cerr << "INVALID ARGUMENT " << Name << " " << Value << "..." << std::endl;
+      printUsage();
+      return 1;
+    }
+  }
+
+  std::cout << sandrokottos::GenerateQuestion{Parameters}().dump() << std::endl;
+
+  return 0;
+}
@@ -1,16 +1,26 @@
 #pragma once
 
 #include <algorithm>
+#include <charconv>
 #include <cmath>
+#include <cstdint>
+#include <iostream>
 #include <istream>
+#include <memory>
+#include <optional>
 #include <iterator>
+#include <numeric>
 #include <ostream>
 #include <ranges>
+#include <string>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "Executor.h"
 #include "Model.h"
 
 namespace sandrokottos {
@@ -23,8 +33,12 @@ inline auto readQuestion(std::istream &Stream) noexcept {
   return Result;
 }
 
-inline auto writeAnswer(std::ostream &Stream, const nlohmann::json &JSON) noexcept {
-  Stream << JSON << std::endl;
+inline auto readAnswer(std::istream &Stream) noexcept {
+  auto Result = nlohmann::json{};
+
+  Stream >> Result;
+
+  return Result;
 }
 
 inline auto getMinute(int OClock) noexcept {
@@ -35,10 +49,42 @@ inline auto getOClock(int Minute) noexcept {
   return (Minute + 30) / 60 * 100 + (Minute + 30) % 60 + 1000;
 }
 
+// 読み込む注文の数の上限です。
+
+constexpr auto MaxOrderSize = 2'000;
+
+// 距離と移動時間の行列を作成して、問題を作成します。行列は、行のブロックごとに実行器のタスクとして並列に作成します。
+
+inline auto createProblem(int RobotSize, int OrderSize, const std::vector<int> &Capacities, const std::vector<std::tuple<int, int>> &TimeWindows, const std::vector<std::tuple<int, int>> &Locations) noexcept {
+  const auto Size = static_cast<int>(std::size(Locations));
+
+  auto DistanceData = std::make_shared_for_overwrite<int[]>(static_cast<std::size_t>(Size) * Size);
+  auto DurationData = std::make_shared_for_overwrite<int[]>(static_cast<std::size_t>(Size) * Size);
+
+  constexpr auto BlockSize = 64;
+
+  getExecutor().map((Size + BlockSize - 1) / BlockSize, [&](const auto &BlockIndex) {
+    for (auto I = BlockIndex * BlockSize; I < std::min((BlockIndex + 1) * BlockSize, Size); ++I) {
+      const auto &[X1, Y1] = Locations[I];
+
+      for (const auto &J : std::views::iota(0, Size)) {
+        const auto &[X2, Y2] = Locations[J];
+
+        const auto Distance = std::abs(X1 - X2) + std::abs(Y1 - Y2);
+
+        DistanceData[static_cast<std::size_t>(I) * Size + J] = Distance;
+        DurationData[static_cast<std::size_t>(I) * Size + J] = (Distance + (5 - 1)) / 5 + 2;
+      }
+    }
+  });
+
+  return Problem{RobotSize, OrderSize, Capacities, TimeWindows, Locations, Matrix{Size, std::move(DistanceData)}, Matrix{Size, std::move(DurationData)}};
+}
+
 inline auto convertToProblem(const nlohmann::json &Question) noexcept {
   const auto RobotSize = static_cast<int>(std::size(Question["robots"]));
 
-  const auto OrderSize = std::min(static_cast<int>(std::size(Question["orders"])), 2'000);
+  const auto OrderSize = std::min(static_cast<int>(std::size(Question["orders"])), MaxOrderSize);
 
   const auto Capacities = [&] {
     auto Result = std::vector<int>{};
@@ -64,104 +110,322 @@ inline auto convertToProblem(const nlohmann::json &Question) noexcept {
     return Result;
   }();
 
-  const auto DistanceMatrix = [&] {
-    const auto Locations = [&] {
-      // c++23がリリースされたら、flat_mapで書き換える。
+  const auto Locations = [&] {
+    // c++23がリリースされたら、flat_mapで書き換える。
 
-      const auto LocationPairs = [&] {
-        auto Result = std::vector<std::vector<std::tuple<int, int>>>{};
+    const auto LocationPairs = [&] {
+      auto Result = std::vector<std::vector<std::tuple<int, int>>>{};
 
-        std::ranges::copy(
-            std::views::iota(0, OrderSize) | std::views::transform([&](const auto &I) {
-              return std::vector<std::tuple<int, int>>{{Question["orders"][I]["r_address"][0], Question["orders"][I]["r_address"][1]},
-                                                       {Question["orders"][I]["u_address"][0], Question["orders"][I]["u_address"][1]}};
-            }),
-            std::back_inserter(Result));
+      std::ranges::copy(
+          std::views::iota(0, OrderSize) | std::views::transform([&](const auto &I) {
+            return std::vector<std::tuple<int, int>>{{Question["orders"][I]["r_address"][0], Question["orders"][I]["r_address"][1]},
+                                                     {Question["orders"][I]["u_address"][0], Question["orders"][I]["u_address"][1]}};
+          }),
+          std::back_inserter(Result));
 
-        return Result;
-      }();
+      return Result;
+    }();
 
-      auto Result = std::vector<std::tuple<int, int>>{};
+    auto Result = std::vector<std::tuple<int, int>>{};
 
-      std::ranges::copy(LocationPairs | std::views::join, std::back_inserter(Result));
+    std::ranges::copy(LocationPairs | std::views::join, std::back_inserter(Result));
 
-      return Result;
-    }();
+    return Result;
+  }();
+
+  return createProblem(RobotSize, OrderSize, Capacities, TimeWindows, Locations);
+}
 
-    auto Result = std::vector<std::vector<int>>{};
+// 回答の作成に必要な、ロボットと注文のIDです。
 
-    std::ranges::copy(
-        Locations | std::views::transform([&](const auto &Location1) {
-          auto Result = std::vector<int>{};
+class Identifiers final {
+  std::vector<std::int64_t> RobotIDs;
+  std::vector<std::int64_t> OrderIDs;
+
+public:
+  explicit Identifiers(const std::vector<std::int64_t> &RobotIDs, const std::vector<std::int64_t> &OrderIDs) noexcept : RobotIDs{RobotIDs}, OrderIDs{OrderIDs} {}
+
+  const auto &getRobotIDs() const noexcept {
+    return RobotIDs;
+  }
 
-          std::ranges::copy(
-              Locations | std::views::transform([&](const auto &Location2) {
-                return std::abs(std::get<0>(Location1) - std::get<0>(Location2)) + std::abs(std::get<1>(Location1) - std::get<1>(Location2));
-              }),
-              std::back_inserter(Result));
+  const auto &getOrderIDs() const noexcept {
+    return OrderIDs;
+  }
+};
 
-          return Result;
+inline auto convertToIdentifiers(const nlohmann::json &Question, const Problem &Problem) noexcept {
+  const auto RobotIDs = [&] {
+    auto Result = std::vector<std::int64_t>{};
+
+    std::ranges::copy(
+        std::views::iota(0, Problem.getRobotSize()) | std::views::transform([&](const auto &I) {
+          return Question["robots"][I]["id"].template get<std::int64_t>();
         }),
         std::back_inserter(Result));
 
     return Result;
   }();
 
-  const auto DurationMatrix = [&] {
-    auto Result = std::vector<std::vector<int>>{};
+  const auto OrderIDs = [&] {
+    auto Result = std::vector<std::int64_t>{};
 
     std::ranges::copy(
-        DistanceMatrix | std::views::transform([&](const auto &Distances) {
-          auto Result = std::vector<int>{};
-
-          std::ranges::copy(
-              Distances | std::views::transform([](const auto &Distance) {
-                return (Distance + (5 - 1)) / 5 + 2;
-              }),
-              std::back_inserter(Result));
-
-          return Result;
+        std::views::iota(0, Problem.getOrderSize()) | std::views::transform([&](const auto &I) {
+          return Question["orders"][I]["id"].template get<std::int64_t>();
         }),
         std::back_inserter(Result));
 
     return Result;
   }();
 
-  return Problem{RobotSize, OrderSize, Capacities, TimeWindows, DistanceMatrix, DurationMatrix};
+  return Identifiers{RobotIDs, OrderIDs};
 }
 
-inline auto convertToAnswer(const nlohmann::json &Question, const Problem &Problem, const Solution &Solution) noexcept {
-  auto Result = nlohmann::json{};
+// 問題を、JSONのDOMを作らずに読み込みます。注文は、読み込んだ順に問題の形式に変換します。
+// ロボットと上限の数の注文を読み込んだら、残りの入力は読み込みません。
+
+class QuestionReader final : public nlohmann::json_sax<nlohmann::json> {
+  int Depth = 0;
+  std::string Section;
+  std::string Field;
+  std::vector<std::int64_t> Address;
+
+  std::int64_t ID = 0;
+  std::int64_t Capacity = 0;
+  std::int64_t StartTime = 0;
+  std::int64_t EndTime = 0;
+  std::tuple<int, int> RAddress;
+  std::tuple<int, int> UAddress;
+
+  bool IsRobotsRead = false;
+
+public:
+  std::vector<int> Capacities;
+  std::vector<std::tuple<int, int>> TimeWindows;
+  std::vector<std::tuple<int, int>> Locations;
+  std::vector<std::int64_t> RobotIDs;
+  std::vector<std::int64_t> OrderIDs;
+
+  auto isCompleted() const noexcept {
+    return IsRobotsRead && static_cast<int>(std::size(OrderIDs)) == MaxOrderSize;
+  }
+
+  bool null() override {
+    return true;
+  }
+
+  bool boolean(bool) override {
+    return true;
+  }
+
+  bool number_integer(number_integer_t Value) override {
+    if (Depth == 3) {
+      if (Field == "id") {
+        ID = Value;
+      } else if (Field == "capacity") {
+        Capacity = Value;
+      } else if (Field == "start_time") {
+        StartTime = Value;
+      } else if (Field == "end_time") {
+        EndTime = Value;
+      }
+    } else if (Depth == 4) {
+      Address.emplace_back(Value);
+    }
+
+    return true;
+  }
+
+  bool number_unsigned(number_unsigned_t Value) override {
+    return number_integer(static_cast<number_integer_t>(Value));
+  }
+
+  bool number_float(number_float_t, const string_t &) override {
+    return true;
+  }
+
+  bool string(string_t &) override {
+    return true;
+  }
+
+  bool binary(binary_t &) override {
+    return true;
+  }
+
+  bool start_object(std::size_t) override {
+    Depth++;
+    return true;
+  }
+
+  // ロボットや注文を読み終えたら、問題の形式に変換します。
+
+  bool end_object() override {
+    if (Depth-- != 3) {
+      return true;
+    }
+
+    if (Section == "robots") {
+      RobotIDs.emplace_back(ID);
+      Capacities.emplace_back(static_cast<int>(Capacity));
+    }
+
+    if (Section == "orders" && static_cast<int>(std::size(OrderIDs)) < MaxOrderSize) {
+      OrderIDs.emplace_back(ID);
+      TimeWindows.emplace_back(getMinute(static_cast<int>(StartTime)), getMinute(static_cast<int>(EndTime)) - 2);
+      Locations.emplace_back(RAddress);
+      Locations.emplace_back(UAddress);
+    }
+
+    return !isCompleted();
+  }
+
+  bool start_array(std::size_t) override {
+    Depth++;
+    Address.clear();
+    return true;
+  }
+
+  bool end_array() override {
+    if (Depth == 4 && std::size(Address) == 2) {
+      (Field == "r_address" ? RAddress : UAddress) = std::make_tuple(static_cast<int>(Address[0]), static_cast<int>(Address[1]));
+    }
+
+    if (Depth-- == 2 && Section == "robots") {
+      IsRobotsRead = true;
+    }
+
+    return !isCompleted();
+  }
+
+  bool key(string_t &Key) override {
+    if (Depth == 1) {
+      Section = Key;
+    } else if (Depth == 3) {
+      Field = Key;
+    }
+
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &) override {
+    return false;
+  }
+};
+
+inline auto readProblem(std::istream &Stream) noexcept -> std::optional<std::tuple<Problem, Identifiers>> {
+  auto Reader = QuestionReader{};
+
+  if (!nlohmann::json::sax_parse(Stream, &Reader) && !Reader.isCompleted()) {
+    std::cerr << "CAN NOT READ QUESTION..." << std::endl;
+    return std::nullopt;
+  }
+
+  return std::make_tuple(createProblem(static_cast<int>(std::size(Reader.RobotIDs)), static_cast<int>(std::size(Reader.OrderIDs)), Reader.Capacities, Reader.TimeWindows, Reader.Locations),
+                         Identifiers{Reader.RobotIDs, Reader.OrderIDs});
+}
 
-  Result["plans"] = [&] {
-    auto Result = nlohmann::json::array();
+// 回答を、JSONのDOMを作らずにバッファーに直接書き出してから出力します。キーの順序は、nlohmann::jsonで出力した場合と同じです。
 
-    std::ranges::copy(
-        std::views::iota(0, static_cast<int>(std::size(Solution.getRoutes()))) | std::views::transform([&](const auto &I) {
-          return nlohmann::json::object(
-              {{"robot", Question["robots"][I]["id"]},
-               {"detail_plans", [&] {
-                  auto Result = nlohmann::json::array();
-
-                  std::ranges::copy(
-                      std::views::iota(0, static_cast<int>(std::size(Solution.getRoutes()[I]))) | std::views::transform([&](const auto &J) {
-                        return nlohmann::json::object(
-                            {{"id", J},
-                             {"order_id", Question["orders"][Solution.getRoutes()[I][J] / 2]["id"]},
-                             {"action", Solution.getRoutes()[I][J] % 2 == 0 ? "load" : "deliver"},
-                             {"start_time", getOClock(Solution.getTimetables()[I][J])}});
-                      }),
-                      std::back_inserter(Result));
-
-                  return Result;
-                }()}});
-        }),
-        std::back_inserter(Result));
+inline auto writeAnswer(std::ostream &Stream, const Identifiers &Identifiers, const Solution &Solution) noexcept {
+  auto Buffer = std::string{};
+
+  Buffer.reserve(std::accumulate(std::begin(Solution.getRoutes()), std::end(Solution.getRoutes()), std::size_t{16}, [](const auto &Acc, const auto &Route) {
+    return Acc + 32 + std::size(Route) * 72;
+  }));
+
+  const auto Append = [&](std::int64_t Value) {
+    char Chars[24];
+
+    Buffer.append(Chars, std::to_chars(std::begin(Chars), std::end(Chars), Value).ptr);
+  };
+
+  Buffer += R"({"plans":[)";
+
+  for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Solution.getRoutes())))) {
+    if (I > 0) {
+      Buffer += ',';
+    }
+
+    Buffer += R"({"detail_plans":[)";
+
+    for (const auto &J : std::views::iota(0, static_cast<int>(std::size(Solution.getRoutes()[I])))) {
+      if (J > 0) {
+        Buffer += ',';
+      }
+
+      Buffer += Solution.getRoutes()[I][J] % 2 == 0 ? R"({"action":"load","id":)" : R"({"action":"deliver","id":)";
+      Append(J);
+      Buffer += R"(,"order_id":)";
+      Append(Identifiers.getOrderIDs()[Solution.getRoutes()[I][J] / 2]);
+      Buffer += R"(,"start_time":)";
+      Append(getOClock(Solution.getTimetables()[I][J]));
+      Buffer += '}';
+    }
+
+    Buffer += R"(],"robot":)";
+    Append(Identifiers.getRobotIDs()[I]);
+    Buffer += '}';
+  }
+
+  Buffer += "]}\n";
+
+  Stream.write(std::data(Buffer), static_cast<std::streamsize>(std::size(Buffer)));
+  Stream.flush();
+}
+
+// 以前の回答を、ソリューションに変換します。問題に含まれない（キャンセルされた）注文は、ノードがないので経路から取り除きます。
+// ただし、FrozenMinuteより前に積み込んで、その時点で配送していない注文の荷物はロボットに積まれたままなので、その個数をロボットごとに一緒にリターンします。
+
+inline auto convertToSolution(const nlohmann::json &Answer, const Identifiers &Identifiers, const Problem &Problem, int FrozenMinute) noexcept {
+  const auto RobotIndices = [&] {
+    auto Result = std::unordered_map<std::int64_t, int>{};
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Identifiers.getRobotIDs())))) {
+      Result.emplace(Identifiers.getRobotIDs()[I], I);
+    }
 
     return Result;
   }();
 
-  return Result;
+  const auto OrderIndices = [&] {
+    auto Result = std::unordered_map<std::int64_t, int>{};
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Identifiers.getOrderIDs())))) {
+      Result.emplace(Identifiers.getOrderIDs()[I], I);
+    }
+
+    return Result;
+  }();
+
+  auto Routes = std::vector<Route>(Problem.getRobotSize());
+  auto Timetables = std::vector<Timetable>(Problem.getRobotSize());
+  auto CancelledLuggageSizes = std::vector<int>(Problem.getRobotSize());
+
+  for (const auto &Plan : Answer["plans"]) {
+    const auto RobotIndex = RobotIndices.find(Plan["robot"].template get<std::int64_t>());
+
+    if (RobotIndex == std::end(RobotIndices)) {
+      continue;
+    }
+
+    for (const auto &DetailPlan : Plan["detail_plans"]) {
+      const auto OrderIndex = OrderIndices.find(DetailPlan["order_id"].template get<std::int64_t>());
+
+      if (OrderIndex == std::end(OrderIndices)) {
+        if (getMinute(DetailPlan["start_time"]) < FrozenMinute) {
+          CancelledLuggageSizes[RobotIndex->second] += DetailPlan["action"] == "load" ? 1 : -1;
+        }
+
+        continue;
+      }
+
+      Routes[RobotIndex->second].emplace_back(OrderIndex->second * 2 + (DetailPlan["action"] == "load" ? 0 : 1));
+      Timetables[RobotIndex->second].emplace_back(getMinute(DetailPlan["start_time"]));
+    }
+  }
+
+  return std::make_tuple(Solution{Routes, Timetables, CalculateCost{Problem}(Routes, Timetables)}, CancelledLuggageSizes);
 }
 
 } // namespace sandrokottos
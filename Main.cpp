@@ -1,15 +1,31 @@
 #include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <fstream>
 #include <future>
 #include <iostream>
 #include <iterator>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <stop_token>
+#include <string_view>
+#include <thread>
 #include <tuple>
+#include <vector>
 
 #include <ortools/constraint_solver/routing_parameters.h>
 
+#include "AnytimeAnswerWriter.h"
+#include "CalculateLowerBound.h"
+#include "Executor.h"
 #include "IO.h"
 #include "OptimizeOrderSize.h"
 #include "OptimizePickupAndDeliveryDuration.h"
+#include "OptimizePickupAndDeliveryDurationByTabuSearch.h"
+#include "ReoptimizeIncrementally.h"
+#include "Snapshot.h"
+#include "SolutionBoard.h"
 #include "SolveCVRPPDTW.h"
 
 inline auto reportSolution(const std::string &Caption, const sandrokottos::Solution &Solution) noexcept {
@@ -19,15 +35,160 @@ inline auto reportSolution(const std::string &Caption, const sandrokottos::Solut
 int main(int ArgCount, char **ArgValues) {
   const auto StartingTime = std::chrono::steady_clock::now();
 
-  const auto Question = sandrokottos::readQuestion(std::cin);
+  // 全体の締め切りです。タイムテーブルの作成は、この時刻までに必ず終わらせます。
 
-  const auto Problem = sandrokottos::convertToProblem(Question);
+  const auto Deadline = StartingTime + std::chrono::milliseconds{19'500};
+
+  // 引数で、スナップショットの書き込み（--write-snapshot PATH）と読み込み（--read-snapshot PATH）、計画の更新（--incremental ANSWER_PATH HHMM）、
+  // 途中経過の出力（--anytime PATH、PATHが"-"なら標準出力）を指定できます。
+
+  const auto Mode = ArgCount >= 3 ? std::string_view{ArgValues[1]} : std::string_view{};
+
+  if (Mode == "--write-snapshot") {
+    const auto Question = sandrokottos::readProblem(std::cin);
+
+    if (!Question) {
+      return 1;
+    }
+
+    auto Stream = std::ofstream{ArgValues[2], std::ios::binary};
+
+    return sandrokottos::writeSnapshot(Stream, std::get<0>(*Question), std::get<1>(*Question)) ? 0 : 1;
+  }
+
+  if (Mode == "--incremental") {
+    // 固定する時刻は、HHMM形式で指定します。不正な場合は、使い方を出力して終了します。
+
+    const auto FrozenOClock = [&]() -> std::optional<int> {
+      if (ArgCount < 4) {
+        return std::nullopt;
+      }
+
+      const auto String = std::string_view{ArgValues[3]};
+
+      auto Result = 0;
+
+      if (const auto [Pointer, ErrorCode] = std::from_chars(std::data(String), std::data(String) + std::size(String), Result); ErrorCode != std::errc{} || Pointer != std::data(String) + std::size(String)) {
+        return std::nullopt;
+      }
+
+      if (Result < 0 || Result / 100 > 23 || Result % 100 > 59) {
+        return std::nullopt;
+      }
+
+      return Result;
+    }();
+
+    if (!FrozenOClock) {
+      std::cerr << "USAGE: sandrokottos --incremental ANSWER_PATH HHMM < question.json" << std::endl;
+      return 1;
+    }
+
+    const auto FrozenMinute = sandrokottos::getMinute(*FrozenOClock);
+
+    const auto Question = sandrokottos::readQuestion(std::cin);
+    const auto Problem = sandrokottos::convertToProblem(Question);
+    const auto Identifiers = sandrokottos::convertToIdentifiers(Question, Problem);
+
+    const auto Answer = [&] {
+      auto Stream = std::ifstream{ArgValues[2]};
+
+      return sandrokottos::readAnswer(Stream);
+    }();
+
+    const auto [Solution, CancelledLuggageSizes] = sandrokottos::convertToSolution(Answer, Identifiers, Problem, FrozenMinute);
+    reportSolution("0", Solution);
+
+    const auto NewSolution = sandrokottos::ReoptimizeIncrementally{Problem}(Solution, FrozenMinute, CancelledLuggageSizes, StartingTime + std::chrono::milliseconds{500}, StartingTime + std::chrono::milliseconds{1'000});
+    reportSolution("4", NewSolution);
+
+    sandrokottos::writeAnswer(std::cout, Identifiers, NewSolution);
+
+    return 0;
+  }
+
+  // 問題は、JSONを読み込みながら変換します（readProblem）。
+
+  const auto Snapshot = [&] {
+    if (Mode == "--read-snapshot") {
+      return sandrokottos::readSnapshot(ArgValues[2]);
+    }
+
+    return sandrokottos::readProblem(std::cin);
+  }();
+
+  if (!Snapshot) {
+    return 1;
+  }
+
+  const auto &[Problem, Identifiers] = *Snapshot;
+
+  // 起動から問題の作成までの時間です。
+
+  std::cerr << "STARTUP:\t" << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - StartingTime).count() << std::endl;
+
+  // 処理はすべて、プロセス全体で共有する実行器のタスクとして実行します。
+
+  auto &Executor = sandrokottos::getExecutor();
+
+  // コストの下界です。解のコストが下界に達したら、それ以上の最適化はしません。
+  // 計算にはノード数の2乗の時間がかかるので、OR-Toolsのモデルの構築と並行して計算します。
+
+  const auto LowerBound = std::shared_future{Executor.submit([&] {
+    return sandrokottos::CalculateLowerBound{Problem}();
+  })};
+
+  // 乱数のシードを、指定した数だけ作成します。
+
+  const auto getSeeds = [](unsigned int Size) {
+    auto Result = std::vector<unsigned int>{};
+
+    std::ranges::copy(
+        std::views::iota(0u, std::max(Size, 1u)),
+        std::back_inserter(Result));
+
+    return Result;
+  };
+
+  // すべての注文を配送できているかを判断します。
+
+  const auto IsAllVisited = [&](const sandrokottos::Solution &Solution) {
+    return std::accumulate(std::begin(Solution.getRoutes()), std::end(Solution.getRoutes()), 0, [](const auto &Acc, const auto &Route) { return Acc + static_cast<int>(std::size(Route)); }) == Problem.getOrderSize() * 2;
+  };
+
+  // すべての注文を配送できているなら積み込み〜配送の総時間を、そうでなければ配送する注文の数を最適化します。
+  // 積み込み〜配送の総時間は、レプリカ交換法とタブー・サーチで並行して最適化して、良い方を採用します。タブー・サーチは、長いタスクとして専用のスレッドで実行します。
+
+  const auto Optimize = [&](const sandrokottos::Solution &Solution, const std::vector<unsigned int> &Seeds, const std::chrono::steady_clock::time_point &TimeLimit, const std::chrono::steady_clock::time_point &Deadline) {
+    if (IsAllVisited(Solution)) {
+      auto Future = Executor.launch([&] {
+        return sandrokottos::OptimizePickupAndDeliveryDurationByTabuSearch{Problem}(Solution, Deadline);
+      });
+
+      const auto Solution1 = sandrokottos::OptimizePickupAndDeliveryDuration{Problem, std::vector<unsigned int>(std::begin(Seeds), std::end(Seeds) - (std::size(Seeds) > 1))}(Solution, LowerBound.get(), Deadline);
+      const auto Solution2 = Executor.get(Future);
+
+      return Solution1.getCost() <= Solution2.getCost() ? Solution1 : Solution2;
+    } else {
+      return sandrokottos::OptimizeOrderSize{Problem}(Solution, TimeLimit, Deadline);
+    }
+  };
+
+  // 見つかったソリューションは、ここで共有します。
+
+  auto Board = sandrokottos::SolutionBoard{};
+
+  auto Writer = std::optional<sandrokottos::AnytimeAnswerWriter>{};
+
+  if (Mode == "--anytime") {
+    Writer.emplace(Identifiers, Board, ArgValues[2]);
+  }
 
   const auto Solution = [&] {
     const auto Solution1 = [&] {
       const auto TimeLimit = StartingTime + std::chrono::milliseconds{15'000};
 
-      auto Future1 = std::async(std::launch::async, [&] {
+      auto Future1 = Executor.launch([&] {
         const auto RoutingSearchParameters = [] {
           auto Result = operations_research::DefaultRoutingSearchParameters();
 
@@ -38,13 +199,13 @@ int main(int ArgCount, char **ArgValues) {
           return Result;
         }();
 
-        const auto Solution = sandrokottos::SolveCVRPPDTW{Problem, RoutingSearchParameters}(TimeLimit);
+        const auto Solution = sandrokottos::SolveCVRPPDTW{Problem, RoutingSearchParameters, Board}(TimeLimit, Deadline);
         reportSolution("1-1", Solution);
 
         return Solution;
       });
 
-      auto Future2 = std::async(std::launch::async, [&] {
+      auto Future2 = Executor.launch([&] {
         const auto RoutingSearchParameters = [] {
           auto Result = operations_research::DefaultRoutingSearchParameters();
 
@@ -55,33 +216,91 @@ int main(int ArgCount, char **ArgValues) {
           return Result;
         }();
 
-        const auto Solution = sandrokottos::SolveCVRPPDTW{Problem, RoutingSearchParameters}(TimeLimit);
+        const auto Solution = sandrokottos::SolveCVRPPDTW{Problem, RoutingSearchParameters, Board, sandrokottos::RoutingObjective::Score}(TimeLimit, Deadline);
         reportSolution("1-2", Solution);
 
         return Solution;
       });
 
-      const auto Solution1 = Future1.get();
-      const auto Solution2 = Future2.get();
+      // OR-Toolsのモデルを構築している間に、下界の計算を待ちます。
+
+      Executor.get(LowerBound);
+      std::cerr << "LB:\t" << std::get<0>(LowerBound.get()) << "\t" << std::get<1>(LowerBound.get()) << "\t" << std::get<2>(LowerBound.get()) << std::endl;
+
+      // OR-Toolsの探索と並行して、公開されたソリューションを残りのコアで最適化して、結果を公開し直します。
+      // 公開されたソリューションがすべての注文を配送するまでは、新しいソリューションが公開されるたびに、配送する注文の数を短い制限時間で最適化します。
+      // すべての注文を配送するソリューションが公開されたら、積み込み〜配送の総時間の最適化に切り替えて、1つのOptimizePickupAndDeliveryDurationに新しいソリューションを取り込ませながら最後まで動かします。
+      // 待っているスレッドがこのタスクを実行しても抜けられるように、OR-Toolsの制限時間でも終了します。
+
+      auto Searching = std::stop_source{};
+
+      auto Future3 = Executor.launch([&] {
+        const auto Seeds = getSeeds(std::max(Executor.getWorkerSize(), 2) - 2);
+
+        for (auto Version = 0; !Searching.stop_requested() && std::chrono::steady_clock::now() < TimeLimit;) {
+          if (Board.getVersion() == Version) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            continue;
+          }
+
+          // 起動から最初のソリューションが見つかるまでの時間を報告します。
+
+          if (Version == 0) {
+            std::cerr << "FIRST:\t" << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - StartingTime).count() << std::endl;
+          }
+
+          Version = Board.getVersion();
+
+          const auto Incumbent = Board.get();
+
+          if (IsAllVisited(*Incumbent)) {
+            Board.publish(sandrokottos::OptimizePickupAndDeliveryDuration{Problem, Seeds}(*Incumbent, LowerBound.get(), TimeLimit, &Board, Searching.get_token()));
+            continue;
+          }
+
+          const auto SliceTimeLimit = std::min(std::chrono::steady_clock::now() + std::chrono::milliseconds{1'000}, TimeLimit);
+
+          Board.publish(sandrokottos::OptimizeOrderSize{Problem}(*Incumbent, SliceTimeLimit, SliceTimeLimit + std::chrono::milliseconds{500}));
+        }
+      });
+
+      Executor.get(Future1);
+      Executor.get(Future2);
+
+      Searching.request_stop();
+      Executor.get(Future3);
 
-      return Solution1.getCost() < Solution2.getCost() ? Solution1 : Solution2;
+      return *Board.get();
     }();
     reportSolution("1", Solution1);
 
-    if (std::accumulate(std::begin(Solution1.getRoutes()), std::end(Solution1.getRoutes()), 0, [](const auto &Acc, const auto &Route) { return Acc + static_cast<int>(std::size(Route)); }) == Problem.getOrderSize() * 2) {
-      const auto Solution2 = sandrokottos::OptimizePickupAndDeliveryDuration{Problem}(Solution1, StartingTime + std::chrono::milliseconds(19'500));
-      reportSolution("2", Solution2);
+    if (Solution1.getCost() <= LowerBound.get()) {
+      return Solution1;
+    }
 
-      return Solution2;
-    } else {
-      const auto Solution3 = sandrokottos::OptimizeOrderSize{Problem}(Solution1, StartingTime + std::chrono::milliseconds(19'500));
-      reportSolution("3", Solution3);
+    // コアの数だけレプリカを作成して並列に最適化します。部分点のタイムテーブルを作成する時間を残すため、注文の追加は締め切りの少し前に打ち切ります。
 
-      return Solution3;
-    }
+    const auto Solution2 = Optimize(Solution1, getSeeds(Executor.getWorkerSize()), StartingTime + std::chrono::milliseconds(19'000), Deadline);
+    reportSolution("2", Solution2);
+
+    return Solution2;
   }();
 
-  sandrokottos::writeAnswer(std::cout, sandrokottos::convertToAnswer(Question, Problem, Solution));
+  Board.publish(Solution);
+
+  // 途中経過を標準出力に出力している場合は、最後の回答も同じ形式で出力します。
+
+  if (Writer) {
+    const auto IsWritingToStdout = std::string_view{ArgValues[2]} == "-";
+
+    Writer.reset();
+
+    if (IsWritingToStdout) {
+      return 0;
+    }
+  }
+
+  sandrokottos::writeAnswer(std::cout, Identifiers, *Board.get());
 
   return 0;
 }
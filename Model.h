@@ -1,31 +1,83 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <ranges>
+#include <span>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include <boost/container/small_vector.hpp>
 #include <ortools/sat/cp_model.h>
+#include <ortools/sat/sat_parameters.pb.h>
 
 namespace sandrokottos {
 
 using Route = boost::container::small_vector<int, 32>;
 using Timetable = boost::container::small_vector<int, 32>;
 
+// 距離や時間の行列です。スナップショットをメモリ・マップした領域を指す場合もあるので、連続した領域で保持します。
+
+class Matrix final {
+  int Size;
+  std::shared_ptr<const int[]> Data;
+
+public:
+  explicit Matrix(int Size, std::shared_ptr<const int[]> Data) noexcept : Size{Size}, Data{std::move(Data)} {}
+
+  explicit Matrix(int Size, std::vector<int> Data) noexcept : Size{Size} {
+    const auto Owner = std::make_shared<std::vector<int>>(std::move(Data));
+
+    this->Data = std::shared_ptr<const int[]>{Owner, Owner->data()};
+  }
+
+  auto getSize() const noexcept {
+    return Size;
+  }
+
+  auto getData() const noexcept {
+    return Data.get();
+  }
+
+  auto operator[](int I) const noexcept {
+    return std::span<const int>{Data.get() + static_cast<std::ptrdiff_t>(I) * Size, static_cast<std::size_t>(Size)};
+  }
+};
+
 class Problem final {
   int RobotSize;
   int OrderSize;
   std::vector<int> Capacities;
   std::vector<std::tuple<int, int>> TimeWindows;
-  std::vector<std::vector<int>> DistanceMatrix;
-  std::vector<std::vector<int>> DurationMatrix;
+  std::vector<std::tuple<int, int>> Locations;
+  Matrix DistanceMatrix;
+  Matrix DurationMatrix;
+  std::vector<std::uint8_t> Score1Table;
+
+  // 配送件数のスコアの表の幅です。これより遅い時刻は、どの注文でも最低点（20）になります。
+
+  static constexpr auto Score1TableWidth = 150 - 2 + 60 + 1;
 
 public:
-  explicit Problem(int RobotSize, int OrderSize, const std::vector<int> &Capacities, const std::vector<std::tuple<int, int>> &TimeWindows, const std::vector<std::vector<int>> &DistanceMatrix, const std::vector<std::vector<int>> &DurationMatrix) noexcept
-      : RobotSize{RobotSize}, OrderSize{OrderSize}, Capacities{Capacities}, TimeWindows{TimeWindows}, DistanceMatrix{DistanceMatrix}, DurationMatrix{DurationMatrix} {}
+  explicit Problem(int RobotSize, int OrderSize, const std::vector<int> &Capacities, const std::vector<std::tuple<int, int>> &TimeWindows, const std::vector<std::tuple<int, int>> &Locations, const Matrix &DistanceMatrix, const Matrix &DurationMatrix) noexcept
+      : RobotSize{RobotSize}, OrderSize{OrderSize}, Capacities{Capacities}, TimeWindows{TimeWindows}, Locations{Locations}, DistanceMatrix{DistanceMatrix}, DurationMatrix{DurationMatrix} {
+    // ノードと時刻ごとの配送件数のスコア（希望配送時間通りなら100、そうでなければ20～80）を、事前に計算しておきます。積み込みのノードは0です。
+
+    Score1Table.resize(static_cast<std::size_t>(OrderSize) * 2 * Score1TableWidth);
+
+    for (const auto &I : std::views::iota(0, OrderSize)) {
+      const auto &[Lower, Upper] = TimeWindows[I];
+
+      for (const auto &Minute : std::views::iota(0, Score1TableWidth)) {
+        Score1Table[static_cast<std::size_t>(I * 2 + 1) * Score1TableWidth + Minute] = static_cast<std::uint8_t>(Lower <= Minute && Minute <= Upper ? 100 : std::max(80 - std::max(Lower - Minute, Minute - Upper), 20));
+      }
+    }
+  }
 
   auto getRobotSize() const noexcept {
     return RobotSize;
@@ -43,6 +95,10 @@ public:
     return TimeWindows;
   }
 
+  const auto &getLocations() const noexcept {
+    return Locations;
+  }
+
   const auto &getDistanceMatrix() const noexcept {
     return DistanceMatrix;
   }
@@ -50,6 +106,10 @@ public:
   const auto &getDurationMatrix() const noexcept {
     return DurationMatrix;
   }
+
+  auto getScore1(int Node, int Minute) const noexcept {
+    return static_cast<int>(Score1Table[static_cast<std::size_t>(Node) * Score1TableWidth + std::clamp(Minute, 0, Score1TableWidth - 1)]);
+  }
 };
 
 class Solution final {
@@ -58,7 +118,7 @@ class Solution final {
   std::tuple<int, int, int> Cost;
 
 public:
-  explicit Solution(const std::vector<Route> &Routes, const std::vector<Timetable> &Timetables, std::tuple<int, int, int> Cost) noexcept : Routes{Routes}, Timetables{Timetables}, Cost{Cost} {}
+  explicit Solution(std::vector<Route> Routes, std::vector<Timetable> Timetables, std::tuple<int, int, int> Cost) noexcept : Routes{std::move(Routes)}, Timetables{std::move(Timetables)}, Cost{Cost} {}
 
   Solution() {}
 
@@ -75,17 +135,146 @@ public:
   }
 };
 
-class CreateStrictTimetable final {
+// CP-SATで解けなかった場合（時間切れを含みます）に備えて、できるだけ早い時刻に積み込みや配送をするタイムテーブルを作成します。
+
+class CreateEarliestTimetable final {
   const sandrokottos::Problem &Problem;
 
+  auto getTimetable(const Route &Route, bool IsWaitingForTimeWindow) const noexcept {
+    auto Result = Timetable{};
+
+    auto Minute = 0;
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Route)))) {
+      if (I > 0) {
+        Minute += Problem.getDurationMatrix()[Route[I - 1]][Route[I]];
+      }
+
+      if (Route[I] % 2 != 0) {
+        Minute = std::max(Minute, 30);
+
+        if (IsWaitingForTimeWindow) {
+          Minute = std::max(Minute, std::get<0>(Problem.getTimeWindows()[Route[I] / 2]));
+        }
+      }
+
+      Result.emplace_back(Minute);
+    }
+
+    return Result;
+  }
+
 public:
-  explicit CreateStrictTimetable(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
+  explicit CreateEarliestTimetable(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
 
   auto operator()(const Route &Route) const noexcept {
+    // 希望配送時間の開始まで待っても13:00の2分前までに配送できるなら、待つタイムテーブルを採用します。
+
+    if (const auto Result = getTimetable(Route, true); Result.empty() || Result.back() <= 150 - 2) {
+      return Result;
+    }
+
+    return getTimetable(Route, false);
+  }
+};
+
+// 全体の締め切りまでの残り時間を、CP-SATの制限時間に設定します。
+// タイムテーブルのモデルは小さくて、呼び出し側がスレッドで並列化しているので、ワーカーは1つにします。ヒントから探索を始めるので、前処理（ヒントが失われることがあります）とプロービングは省略します。
+
+inline auto getSatParameters(const std::chrono::steady_clock::time_point &Deadline) noexcept {
+  auto Result = operations_research::sat::SatParameters{};
+
+  Result.set_max_time_in_seconds(std::chrono::duration<double>(Deadline - std::chrono::steady_clock::now()).count());
+  Result.set_num_search_workers(1);
+  Result.set_cp_model_presolve(false);
+  Result.set_cp_model_probing_level(0);
+
+  return Result;
+}
+
+// 注文（Order）の積み込みをPIndex番目、配送をDIndex番目に挿入した経路を、呼び出し側が用意したバッファーに作成します。容量が足りていれば、メモリは確保しません。
+
+inline auto getInsertedRoute(const Route &Route, int Order, int PIndex, int DIndex, sandrokottos::Route &Result) noexcept {
+  Result.clear();
+
+  auto it = std::begin(Route);
+
+  for (auto I = 0; I < PIndex; ++I, ++it) {
+    Result.emplace_back(*it);
+  }
+
+  Result.emplace_back(Order * 2 + 0);
+
+  for (auto I = PIndex + 1; I < DIndex; ++I, ++it) {
+    Result.emplace_back(*it);
+  }
+
+  Result.emplace_back(Order * 2 + 1);
+
+  for (; it != std::end(Route); ++it) {
+    Result.emplace_back(*it);
+  }
+}
+
+// 別の経路のタイムテーブルを、新しい経路に写します。別の経路にないノードの時刻は0にするので、getHintTimetableで補正してから使用します。
+// 注文を1つ移動した経路では、ほとんどのノードの時刻が移動前と同じになります。
+
+inline auto getMappedTimetable(const Route &FromRoute, const Timetable &FromTimetable, const Route &ToRoute) noexcept {
+  auto Result = Timetable{};
+
+  for (const auto &Node : ToRoute) {
+    const auto Iterator = std::find(std::begin(FromRoute), std::end(FromRoute), Node);
+
+    Result.emplace_back(Iterator != std::end(FromRoute) ? FromTimetable[std::distance(std::begin(FromRoute), Iterator)] : 0);
+  }
+
+  return Result;
+}
+
+// CP-SATのヒントにするタイムテーブルです。移動時間を満たすように、ヒントの時刻より早いノードを遅らせます。
+
+inline auto getHintTimetable(const sandrokottos::Problem &Problem, const Route &Route, const Timetable &Hint) noexcept {
+  auto Result = Timetable{};
+
+  auto Minute = 0;
+
+  for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Route)))) {
+    if (I > 0) {
+      Minute += Problem.getDurationMatrix()[Route[I - 1]][Route[I]];
+    }
+
+    if (Route[I] % 2 != 0) {
+      Minute = std::max(Minute, 30);
+    }
+
+    Minute = std::max(Minute, Hint[I]);
+
+    Result.emplace_back(Minute);
+  }
+
+  return Result;
+}
+
+class CreateStrictTimetable final {
+  const sandrokottos::Problem &Problem;
+  std::chrono::steady_clock::time_point Deadline;
+
+public:
+  explicit CreateStrictTimetable(const sandrokottos::Problem &Problem, const std::chrono::steady_clock::time_point &Deadline) noexcept : Problem{Problem}, Deadline{Deadline} {}
+
+  // Hintの時刻から、CP-SATの探索を始めます。HintはRouteと同じ長さでなければなりません。
+
+  auto operator()(const Route &Route, const Timetable &Hint) const noexcept {
     if (Route.empty()) {
       return Timetable{};
     }
 
+    // 締め切りを過ぎている場合は、CP-SATを使わずにタイムテーブルを作成します。
+
+    if (std::chrono::steady_clock::now() >= Deadline) {
+      return CreateEarliestTimetable{Problem}(Route);
+    }
+
     auto ModelBuilder = operations_research::sat::CpModelBuilder{};
 
     // 積み込みや配送の時刻を表現する変数を作成します。
@@ -102,6 +291,10 @@ public:
       return Result;
     }();
 
+    // ヒントにするタイムテーブルです。
+
+    const auto HintTimetable = getHintTimetable(Problem, Route, Hint);
+
     // 積み込みや配送の時刻を計算しながら、配送時刻の制約を追加して、コストを作成します。
 
     const auto TotalCostExpr = [&] {
@@ -118,7 +311,11 @@ public:
 
         // 時刻に待ち時間を追加します。
 
-        MinuteExpr.AddVar(ModelBuilder.NewIntVar({0, 150 - 2}));
+        const auto Waiting = ModelBuilder.NewIntVar({0, 150 - 2});
+        MinuteExpr.AddVar(Waiting);
+
+        ModelBuilder.AddHint(Minutes[I], HintTimetable[I]);
+        ModelBuilder.AddHint(Waiting, HintTimetable[I] - (I > 0 ? HintTimetable[I - 1] + Problem.getDurationMatrix()[Route[I - 1]][Route[I]] : 0));
 
         // 時刻を変数に設定します。
 
@@ -162,11 +359,16 @@ public:
 
     // 問題を解きます。
 
-    const auto Solution = operations_research::sat::Solve(ModelBuilder.Build());
+    const auto Solution = operations_research::sat::SolveWithParameters(ModelBuilder.Build(), getSatParameters(Deadline));
 
-    if (Solution.status() == operations_research::sat::CpSolverStatus::INFEASIBLE) {
-      std::cerr << "SAT FAILED..." << std::endl;
-      return Timetable{};
+    // 解が見つからなかった場合は、CP-SATを使わずに作成したタイムテーブルをリターンします。
+
+    if (Solution.status() != operations_research::sat::CpSolverStatus::OPTIMAL && Solution.status() != operations_research::sat::CpSolverStatus::FEASIBLE) {
+      if (Solution.status() == operations_research::sat::CpSolverStatus::INFEASIBLE) {
+        std::cerr << "SAT FAILED..." << std::endl;
+      }
+
+      return CreateEarliestTimetable{Problem}(Route);
     }
 
     // タイムテーブルを作成してリターンします。
@@ -183,19 +385,36 @@ public:
       return Result;
     }();
   }
+
+  // ヒントがない場合は、最も早いタイムテーブルをヒントにします。
+
+  auto operator()(const Route &Route) const noexcept {
+    return (*this)(Route, CreateEarliestTimetable{Problem}(Route));
+  }
 };
 
 class CreateRelaxedTimetable final {
   const sandrokottos::Problem &Problem;
+  std::chrono::steady_clock::time_point Deadline;
 
 public:
-  explicit CreateRelaxedTimetable(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
+  explicit CreateRelaxedTimetable(const sandrokottos::Problem &Problem, const std::chrono::steady_clock::time_point &Deadline) noexcept : Problem{Problem}, Deadline{Deadline} {}
 
-  auto operator()(const Route &Route) const noexcept {
+  // Hintの時刻から、CP-SATの探索を始めます。HintはRouteと同じ長さでなければなりません。
+  // 先頭からFrozenSize個のノードはHintの時刻に固定して、それ以降のノードはFrozenMinuteより前にしません（計画の更新で使用します）。
+  // 固定する場合は、CP-SATで解が見つからなかったときにHintをそのままリターンするので、Hintは実行可能なタイムテーブルでなければなりません。
+
+  auto operator()(const Route &Route, const Timetable &Hint, int FrozenSize, int FrozenMinute) const noexcept {
     if (Route.empty()) {
       return Timetable{};
     }
 
+    // 締め切りを過ぎている場合は、CP-SATを使わずにタイムテーブルを作成します。
+
+    if (std::chrono::steady_clock::now() >= Deadline) {
+      return FrozenSize > 0 ? Hint : CreateEarliestTimetable{Problem}(Route);
+    }
+
     auto ModelBuilder = operations_research::sat::CpModelBuilder{};
 
     // 積み込みや配送の時刻を表現する変数を作成します。
@@ -226,6 +445,10 @@ public:
       return Result;
     }();
 
+    // ヒントにするタイムテーブルです。
+
+    const auto HintTimetable = getHintTimetable(Problem, Route, Hint);
+
     // 積み込みや配送の時刻を計算しながら、配送時刻の制約を追加して、コストを作成します。
 
     const auto TotalCostExpr = [&] {
@@ -242,12 +465,24 @@ public:
 
         // 時刻に待ち時間を追加します。
 
-        MinuteExpr.AddVar(ModelBuilder.NewIntVar({0, 150 - 2}));
+        const auto Waiting = ModelBuilder.NewIntVar({0, 150 - 2});
+        MinuteExpr.AddVar(Waiting);
+
+        ModelBuilder.AddHint(Minutes[I], HintTimetable[I]);
+        ModelBuilder.AddHint(Waiting, HintTimetable[I] - (I > 0 ? HintTimetable[I - 1] + Problem.getDurationMatrix()[Route[I - 1]][Route[I]] : 0));
 
         // 時刻を変数に設定します。
 
         ModelBuilder.AddEquality(Minutes[I], MinuteExpr);
 
+        // 固定した部分は、Hintの時刻から動かしません。
+
+        if (I < FrozenSize) {
+          ModelBuilder.AddEquality(Minutes[I], Hint[I]);
+        } else {
+          ModelBuilder.AddGreaterOrEqual(Minutes[I], FrozenMinute);
+        }
+
         // 積み込みの場合は、制約やコスト変数とは無関係なのでコンティニューします。
 
         if (Route[I] % 2 == 0) {
@@ -258,6 +493,7 @@ public:
 
         ModelBuilder.AddGreaterOrEqual(Minutes[I], 30);
         ModelBuilder.AddLinearConstraint(Minutes[I], {std::get<0>(Problem.getTimeWindows()[Route[I] / 2]), std::get<1>(Problem.getTimeWindows()[Route[I] / 2])}).OnlyEnforceIf(OnTimes[I]);
+        ModelBuilder.AddHint(OnTimes[I], Problem.getScore1(Route[I], HintTimetable[I]) == 100);
 
         // 配送件数（希望配送時間通りなら0、そうでなければ20～80）を変数に設定します。
 
@@ -331,11 +567,16 @@ public:
 
     // 問題を解きます。
 
-    const auto Solution = operations_research::sat::Solve(ModelBuilder.Build());
+    const auto Solution = operations_research::sat::SolveWithParameters(ModelBuilder.Build(), getSatParameters(Deadline));
 
-    if (Solution.status() == operations_research::sat::CpSolverStatus::INFEASIBLE) {
-      std::cerr << "SAT FAILED..." << std::endl;
-      return Timetable{};
+    // 解が見つからなかった場合は、CP-SATを使わずに作成したタイムテーブルをリターンします。
+
+    if (Solution.status() != operations_research::sat::CpSolverStatus::OPTIMAL && Solution.status() != operations_research::sat::CpSolverStatus::FEASIBLE) {
+      if (Solution.status() == operations_research::sat::CpSolverStatus::INFEASIBLE) {
+        std::cerr << "SAT FAILED..." << std::endl;
+      }
+
+      return FrozenSize > 0 ? Hint : CreateEarliestTimetable{Problem}(Route);
     }
 
     // タイムテーブルを作成してリターンします。
@@ -352,6 +593,138 @@ public:
       return Result;
     }();
   }
+
+  auto operator()(const Route &Route, const Timetable &Hint) const noexcept {
+    return (*this)(Route, Hint, 0, 0);
+  }
+
+  // ヒントがない場合は、最も早いタイムテーブルをヒントにします。
+
+  auto operator()(const Route &Route) const noexcept {
+    return (*this)(Route, CreateEarliestTimetable{Problem}(Route));
+  }
+};
+
+// 計算するスコアを、コンパイル時に指定するためのポリシーです。
+
+template <bool IsScore1Enabled, bool IsScore2Enabled, bool IsScore3Enabled>
+struct CostPolicy final {
+  static constexpr auto IsScore1 = IsScore1Enabled;
+  static constexpr auto IsScore2 = IsScore2Enabled;
+  static constexpr auto IsScore3 = IsScore3Enabled;
+};
+
+using AllScores = CostPolicy<true, true, true>;
+using DurationScores = CostPolicy<false, true, true>;
+
+// 経路の途中（先頭からI番目の直前）までの、コストの計算結果です。
+
+struct CostState final {
+  int Score1 = 0;
+  int Score2 = 0;
+  int Score3 = 0;
+  int LuggageSize = 0;
+};
+
+// 経路のコストを計算します。
+// 途中までの計算結果を使えば、経路の後ろの部分だけを変更した場合のコストを、変更した位置から計算できます。
+
+template <typename Policy>
+class CalculateRouteCost final {
+  const sandrokottos::Problem &Problem;
+
+  auto next(CostState &State, const Route &Route, const Timetable &Timetable, int I) const noexcept {
+    const auto IsPickup = 1 - Route[I] % 2;
+
+    if constexpr (Policy::IsScore1) {
+      State.Score1 += Problem.getScore1(Route[I], Timetable[I]);
+    }
+
+    if constexpr (Policy::IsScore2) {
+      if (I > 0) {
+        State.Score2 += (Timetable[I] - Timetable[I - 1]) * State.LuggageSize;
+      }
+
+      State.Score2 -= 2 * IsPickup; // 次の位置で積み込み時間＋移動時間が足されるので、事前に積み込み時間分を減らしておきます。
+    }
+
+    if constexpr (Policy::IsScore3) {
+      if (I > 0) {
+        State.Score3 += Problem.getDistanceMatrix()[Route[I - 1]][Route[I]];
+      }
+    }
+
+    State.LuggageSize += IsPickup * 2 - 1;
+  }
+
+  static auto getResult(const CostState &State) noexcept {
+    return std::tuple_cat(
+        [&] {
+          if constexpr (Policy::IsScore1) {
+            return std::make_tuple(-State.Score1);
+          } else {
+            return std::tuple<>{};
+          }
+        }(),
+        [&] {
+          if constexpr (Policy::IsScore2) {
+            return std::make_tuple(State.Score2);
+          } else {
+            return std::tuple<>{};
+          }
+        }(),
+        [&] {
+          if constexpr (Policy::IsScore3) {
+            return std::make_tuple(State.Score3);
+          } else {
+            return std::tuple<>{};
+          }
+        }());
+  }
+
+public:
+  explicit CalculateRouteCost(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
+
+  auto operator()(const Route &Route, const Timetable &Timetable) const noexcept {
+    return (*this)(CostState{}, Route, Timetable, 0);
+  }
+
+  // From番目より前が同じ経路の計算結果（State）から、コストを計算します。
+
+  auto operator()(const CostState &State, const Route &Route, const Timetable &Timetable, int From) const noexcept {
+    auto Result = State;
+
+    for (auto I = From; I < static_cast<int>(std::size(Route)); ++I) {
+      next(Result, Route, Timetable, I);
+    }
+
+    return getResult(Result);
+  }
+
+  // 経路の位置ごとの、途中までの計算結果を作成します。タイムテーブルが経路の途中までしかない場合は、そこまでを作成します。
+
+  auto getStates(const Route &Route, const Timetable &Timetable) const noexcept {
+    auto Result = std::vector<CostState>{};
+
+    getStates(Route, Timetable, Result);
+
+    return Result;
+  }
+
+  // 呼び出し側が用意したバッファーに作成します。容量が足りていれば、メモリは確保しません。
+
+  auto getStates(const Route &Route, const Timetable &Timetable, std::vector<CostState> &Result) const noexcept {
+    Result.clear();
+    Result.reserve(std::size(Timetable) + 1);
+
+    Result.emplace_back();
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::min(std::size(Route), std::size(Timetable))))) {
+      Result.emplace_back(Result.back());
+
+      next(Result.back(), Route, Timetable, I);
+    }
+  }
 };
 
 class CalculateCost final {
@@ -361,33 +734,130 @@ public:
   CalculateCost(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
 
   auto operator()(const std::vector<Route> &Routes, const std::vector<Timetable> &Timetables) const noexcept {
-    auto Score1 = 0;
-    auto Score2 = 0;
-    auto Score3 = 0;
+    auto Result = std::make_tuple(0, 0, 0);
 
     for (const auto &I : std::views::iota(0, Problem.getRobotSize())) {
-      auto LuggageSize = 0;
+      const auto [Score1, Score2, Score3] = CalculateRouteCost<AllScores>{Problem}(Routes[I], Timetables[I]);
 
-      for (const auto &J : std::views::iota(0, static_cast<int>(std::size(Routes[I])))) {
-        if (J > 0) {
-          Score2 += (Timetables[I][J] - Timetables[I][J - 1]) * LuggageSize;
-          Score3 += Problem.getDistanceMatrix()[Routes[I][J - 1]][Routes[I][J]];
-        }
+      Result = std::make_tuple(std::get<0>(Result) + Score1, std::get<1>(Result) + Score2, std::get<2>(Result) + Score3);
+    }
 
-        if (Routes[I][J] % 2 == 0) {
-          LuggageSize++;
+    return Result;
+  }
+};
 
-          Score2 -= 2; // 次のループで積み込み時間＋移動時間が足されるので、事前に積み込み時間分を減らしておきます。
-        } else {
-          LuggageSize--;
+// 最適化の途中の、変更できる解です。経路ごとのコストを保持して、変更した経路のコストだけを計算し直すので、全体のコストの更新は変更した経路の数に比例します。
+// コストを指定せずに変更した経路は、次にコストを参照した時に計算します。参照がconstでもキャッシュを更新するので、複数のスレッドから参照する場合は、先にgetCost()を呼び出してください。
 
-          const auto &[Lower, Upper] = Problem.getTimeWindows()[Routes[I][J] / 2];
-          Score1 += Lower <= Timetables[I][J] && Timetables[I][J] <= Upper ? 100 : std::max(80 - std::max(Lower - Timetables[I][J], Timetables[I][J] - Upper), 20);
-        }
-      }
+class WorkingSolution final {
+  const sandrokottos::Problem *Problem; // レプリカの交換などで代入できるように、参照ではなくポインターで保持します。
+
+  std::vector<Route> Routes;
+  std::vector<Timetable> Timetables;
+
+  mutable std::vector<std::tuple<int, int, int>> RouteCosts;
+  mutable std::vector<int> DirtyIndices;
+  mutable std::vector<bool> IsDirty;
+  mutable std::tuple<int, int, int> Cost;
+
+  static auto add(const std::tuple<int, int, int> &Cost1, const std::tuple<int, int, int> &Cost2, int Sign) noexcept {
+    return std::make_tuple(std::get<0>(Cost1) + std::get<0>(Cost2) * Sign, std::get<1>(Cost1) + std::get<1>(Cost2) * Sign, std::get<2>(Cost1) + std::get<2>(Cost2) * Sign);
+  }
+
+  auto update(int I, const std::tuple<int, int, int> &RouteCost) const noexcept {
+    Cost = add(add(Cost, RouteCosts[I], -1), RouteCost, 1);
+    RouteCosts[I] = RouteCost;
+  }
+
+  auto update() const noexcept {
+    for (const auto &I : DirtyIndices) {
+      update(I, CalculateRouteCost<AllScores>{*Problem}(Routes[I], Timetables[I]));
+      IsDirty[I] = false;
+    }
+
+    DirtyIndices.clear();
+  }
+
+public:
+  explicit WorkingSolution(const sandrokottos::Problem &Problem, const Solution &Solution) noexcept
+      : Problem{&Problem}, Routes{Solution.getRoutes()}, Timetables{Solution.getTimetables()}, IsDirty(std::size(Routes), false), Cost{0, 0, 0} {
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+      RouteCosts.emplace_back(CalculateRouteCost<AllScores>{Problem}(Routes[I], Timetables[I]));
+      Cost = add(Cost, RouteCosts.back(), 1);
+    }
+  }
+
+  const auto &getRoutes() const noexcept {
+    return Routes;
+  }
+
+  const auto &getTimetables() const noexcept {
+    return Timetables;
+  }
+
+  // 経路を変更します。コストは、次に参照した時に計算します。
+
+  auto setRoute(int I, const Route &Route, const Timetable &Timetable) noexcept {
+    Routes[I] = Route;
+    Timetables[I] = Timetable;
+
+    if (!IsDirty[I]) {
+      IsDirty[I] = true;
+      DirtyIndices.emplace_back(I);
+    }
+  }
+
+  // タイムテーブルだけを変更します。コストは、次に参照した時に計算します。
+
+  auto setTimetable(int I, const Timetable &Timetable) noexcept {
+    Timetables[I] = Timetable;
+
+    if (!IsDirty[I]) {
+      IsDirty[I] = true;
+      DirtyIndices.emplace_back(I);
+    }
+  }
+
+  // 候補の評価で計算済みのコスト（CalculateRouteCost<AllScores>の結果）と一緒に、経路を変更します。コストは計算し直しません。
+
+  auto setRoute(int I, const Route &Route, const Timetable &Timetable, const std::tuple<int, int, int> &RouteCost) noexcept {
+    Routes[I] = Route;
+    Timetables[I] = Timetable;
+
+    if (IsDirty[I]) {
+      IsDirty[I] = false;
+      std::erase(DirtyIndices, I);
+    }
+
+    update(I, RouteCost);
+  }
+
+  auto getRouteCost(int I) const noexcept {
+    if (IsDirty[I]) {
+      update(I, CalculateRouteCost<AllScores>{*Problem}(Routes[I], Timetables[I]));
+      IsDirty[I] = false;
+      std::erase(DirtyIndices, I);
     }
 
-    return std::make_tuple(-Score1, Score2, Score3);
+    return RouteCosts[I];
+  }
+
+  const auto &getCost() const noexcept {
+    update();
+
+    return Cost;
+  }
+
+  // 変更できない解を作成します。コストは保持しているものを使うので、全体を計算し直しません。
+
+  auto getSolution() const & noexcept {
+    return sandrokottos::Solution(Routes, Timetables, getCost());
+  }
+
+  auto getSolution() && noexcept {
+    const auto Cost = getCost();
+
+    return sandrokottos::Solution(std::move(Routes), std::move(Timetables), Cost);
   }
 };
 
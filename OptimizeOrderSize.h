@@ -6,50 +6,37 @@
 #include <limits>
 #include <ranges>
 #include <tuple>
+#include <utility>
 #include <vector>
 
+#include "CalculateLowerBound.h"
+#include "Executor.h"
 #include "Model.h"
 
 namespace sandrokottos {
 
 // 部分点をかき集めて、配送できた件数を最大化します。
+// 経路ごとのコストはWorkingSolutionで保持して、挿入した経路のコストだけを更新します。
+// 挿入の候補を評価するループではメモリを確保しないように、経路やタイムテーブルは呼び出し側が用意したバッファー（ワーカーごとの作業領域）に作成します。
 
 class OptimizeOrderSize final {
-  const sandrokottos::Problem &Problem;
-
-  auto getNewRoute(const Route &Route, int Order, int PIndex, int DIndex) const noexcept {
-    // auto Result = Route;
-
-    // Result.emplace(std::begin(Result) + PIndex, Order * 2 + 0);
-    // Result.emplace(std::begin(Result) + DIndex, Order * 2 + 1);
-
-    // return Result;
-
-    auto Result = sandrokottos::Route{};
-
-    auto it = std::begin(Route);
-
-    for (auto I = 0; I < PIndex; ++I, ++it) {
-      Result.emplace_back(*it);
-    }
+  friend class Benchmark;
 
-    Result.emplace_back(Order * 2 + 0);
-
-    for (auto I = PIndex + 1; I < DIndex; ++I, ++it) {
-      Result.emplace_back(*it);
-    }
+  const sandrokottos::Problem &Problem;
 
-    Result.emplace_back(Order * 2 + 1);
+  // 候補の評価に使うバッファーです。反復のたびに作り直さずに、ワーカーごとに使い回します。
 
-    for (; it != std::end(Route); ++it) {
-      Result.emplace_back(*it);
-    }
+  struct Scratch final {
+    Route NewRoute;
+    Timetable NewTimetable;
+    Timetable TimetablePrefix;
+    std::vector<CostState> States;
+  };
 
-    return Result;
-  }
+  // 積み込みや配送ができなくなる直前までの、タイムテーブルを作成します。
 
-  auto getNewTimetable(const Route &Route, int RIndex) const noexcept {
-    auto Result = Timetable{};
+  auto getTimetablePrefix(const Route &Route, int RIndex, Timetable &Result) const noexcept {
+    Result.clear();
 
     auto Minute = 0;
     auto LuggageSize = 0;
@@ -63,56 +50,38 @@ class OptimizeOrderSize final {
 
       if (Route[I] % 2 == 0) {
         if (++LuggageSize > Problem.getCapacities()[RIndex]) { // キャパシティーを超えて積み込むことはできません。
-          return Timetable{};
+          Result.pop_back();
+          return;
         }
       } else {
         Minute = std::max(Minute, 30);
 
         if (Minute > 150 - 2) { // 13:00の2分前までに配送しなければなりません。
-          return Timetable{};
+          Result.pop_back();
+          return;
         }
 
         LuggageSize--;
       }
     }
-
-    return Result;
   }
 
-  auto getCost(const Route &Route, const Timetable &Timetable) const noexcept {
-    auto Score1 = 0;
-    auto Score2 = 0;
-    auto Score3 = 0;
-
-    auto LuggageSize = 0;
-
-    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Route)))) {
-      if (I > 0) {
-        Score2 += (Timetable[I] - Timetable[I - 1]) * LuggageSize;
-        Score3 += Problem.getDistanceMatrix()[Route[I - 1]][Route[I]];
-      }
-
-      if (Route[I] % 2 == 0) {
-        LuggageSize++;
-
-        Score2 -= 2; // 次のループで積み込み時間＋移動時間が足されるので、事前に積み込み時間分を減らしておきます。
-      } else {
-        LuggageSize--;
+  // 経路の最後まで積み込みや配送ができる場合だけ、trueをリターンします。
 
-        const auto &[Lower, Upper] = Problem.getTimeWindows()[Route[I] / 2];
-        Score1 += Lower <= Timetable[I] && Timetable[I] <= Upper ? 100 : std::max(80 - std::max(Lower - Timetable[I], Timetable[I] - Upper), 20);
-      }
-    }
+  auto getNewTimetable(const Route &Route, int RIndex, Timetable &Result) const noexcept {
+    getTimetablePrefix(Route, RIndex, Result);
 
-    return std::make_tuple(-Score1, Score2, Score3);
+    return std::size(Result) == std::size(Route);
   }
 
 public:
   OptimizeOrderSize(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
 
-  auto operator()(const Solution &Solution, const std::chrono::steady_clock::time_point &TimeLimit) noexcept {
-    auto Routes = Solution.getRoutes();
-    auto Timetables = Solution.getTimetables();
+  auto operator()(const Solution &Solution, const std::chrono::steady_clock::time_point &TimeLimit, const std::chrono::steady_clock::time_point &Deadline) noexcept {
+    auto Working = WorkingSolution{Problem, Solution};
+
+    const auto &Routes = Working.getRoutes();
+    const auto &Timetables = Working.getTimetables();
 
     auto Orders = [&] {
       auto Result = std::vector<int>{};
@@ -131,44 +100,102 @@ public:
         }
       }
 
+      // どのように配送してもスコアが0の注文は、追加してもコストが悪くなるだけなので、候補から外します。
+
+      const auto MaxScore1s = CalculateLowerBound{Problem}.getMaxScore1s();
+
+      std::erase_if(Result, [&](const auto &Order) {
+        return MaxScore1s[Order] == 0;
+      });
+
       return Result;
     }();
 
+    auto RIndices = std::vector<int>{};
+    auto Costs = std::vector<std::tuple<int, int, int>>{};
+
     while (!Orders.empty() && std::chrono::steady_clock::now() <= TimeLimit) {
-      const auto [Order, I, Route, Timetable] = [&] {
-        auto Result = std::make_tuple(-1, 0, sandrokottos::Route{}, sandrokottos::Timetable{});
+      // 空の経路は、キャパシティーが同じなら挿入の候補も同じになるので、キャパシティーごとに最初の経路だけを評価します。
 
-        auto BestDelta = std::make_tuple(0, 0, 0);
+      RIndices.clear();
 
-        for (const auto &Order : Orders) {
+      for (const auto &RIndex : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+        if (Routes[RIndex].empty() && std::ranges::any_of(RIndices, [&](const auto &I) { return Routes[I].empty() && Problem.getCapacities()[I] == Problem.getCapacities()[RIndex]; })) {
+          continue;
+        }
+
+        RIndices.emplace_back(RIndex);
+      }
+
+      // 挿入前の経路のコストです。前回の反復から変わったのは挿入した経路だけなので、保持しているものを使います。
+
+      Costs.clear();
+
+      for (const auto &RIndex : RIndices) {
+        Costs.emplace_back(Working.getRouteCost(RIndex));
+      }
+
+      // 注文をチャンクに分けて、チャンクごとの最良の挿入を実行器のタスクとして並列に探します。チャンクの順に比較するので、結果は逐次に探した場合と同じです。
+
+      const auto ChunkSize = std::min(static_cast<int>(std::size(Orders)), getExecutor().getWorkerSize() * 4);
+
+      const auto Candidates = getExecutor().map(ChunkSize, [&](const auto &ChunkIndex) {
+        auto &[NewRoute, NewTimetable, TimetablePrefix, States] = Executor::getScratch<Scratch>();
+
+        auto Result = std::make_tuple(std::make_tuple(0, 0, 0), -1, 0, sandrokottos::Route{}, sandrokottos::Timetable{});
+
+        auto &BestDelta = std::get<0>(Result);
+
+        for (const auto &Order : Orders | std::views::drop(std::size(Orders) * ChunkIndex / ChunkSize) | std::views::take(std::size(Orders) * (ChunkIndex + 1) / ChunkSize - std::size(Orders) * ChunkIndex / ChunkSize)) {
           if (!(std::chrono::steady_clock::now() <= TimeLimit)) {
             return Result;
           }
 
-          for (const auto &RIndex : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
-            const auto Cost = getCost(Routes[RIndex], Timetables[RIndex]);
+          for (const auto &J : std::views::iota(0, static_cast<int>(std::size(RIndices)))) {
+            const auto &RIndex = RIndices[J];
+            const auto &Cost = Costs[J];
+
+            // 挿入位置より前は、挿入前の経路と同じタイムテーブルになるので、途中までのコストを使い回します。
 
-            for (const auto &PIndex : std::views::iota(0, static_cast<int>(std::size(Routes[RIndex]) + 1))) {
+            getTimetablePrefix(Routes[RIndex], RIndex, TimetablePrefix);
+            CalculateRouteCost<AllScores>{Problem}.getStates(Routes[RIndex], TimetablePrefix, States);
+
+            for (const auto &PIndex : std::views::iota(0, static_cast<int>(std::size(States)))) {
               for (const auto &DIndex : std::views::iota(PIndex + 1, static_cast<int>(std::size(Routes[RIndex]) + 2))) {
-                const auto NewRoute = getNewRoute(Routes[RIndex], Order, PIndex, DIndex);
-                const auto NewTimetable = getNewTimetable(NewRoute, RIndex);
+                getInsertedRoute(Routes[RIndex], Order, PIndex, DIndex, NewRoute);
 
-                if (NewTimetable.empty()) {
+                if (!getNewTimetable(NewRoute, RIndex, NewTimetable)) {
                   continue;
                 }
 
-                const auto NewCost = getCost(NewRoute, NewTimetable);
+                const auto NewCost = CalculateRouteCost<AllScores>{Problem}(States[PIndex], NewRoute, NewTimetable, PIndex);
                 const auto Delta = std::make_tuple(std::get<0>(NewCost) - std::get<0>(Cost), std::get<1>(NewCost) - std::get<1>(Cost), std::get<2>(NewCost) - std::get<2>(Cost));
 
                 if (Delta < BestDelta) {
                   BestDelta = Delta;
-                  Result = std::make_tuple(Order, RIndex, NewRoute, NewTimetable);
+
+                  std::get<1>(Result) = Order;
+                  std::get<2>(Result) = RIndex;
+                  std::get<3>(Result) = NewRoute;
+                  std::get<4>(Result) = NewTimetable;
                 }
               }
             }
           }
         }
 
+        return Result;
+      });
+
+      const auto [Delta, Order, I, Route, Timetable] = [&] {
+        auto Result = std::make_tuple(std::make_tuple(0, 0, 0), -1, 0, sandrokottos::Route{}, sandrokottos::Timetable{});
+
+        for (const auto &Candidate : Candidates) {
+          if (std::get<0>(Candidate) < std::get<0>(Result)) {
+            Result = Candidate;
+          }
+        }
+
         return Result;
       }();
 
@@ -178,23 +205,30 @@ public:
 
       std::erase(Orders, Order);
 
-      Routes[I] = Route;
-      Timetables[I] = Timetable;
+      // 挿入後の経路のコストは、挿入前のコストと差分から分かるので、計算し直しません。
+
+      const auto Cost = Working.getRouteCost(I);
+
+      Working.setRoute(I, Route, Timetable, std::make_tuple(std::get<0>(Cost) + std::get<0>(Delta), std::get<1>(Cost) + std::get<1>(Delta), std::get<2>(Cost) + std::get<2>(Delta)));
     }
 
-    Timetables = [&] {
-      auto Result = std::vector<Timetable>{};
+    // 挿入の際に作成したタイムテーブルをヒントにして、タイムテーブルを並列に作り直します。
 
-      std::ranges::copy(
-          Routes | std::views::transform([&](const auto &Route) {
-            return CreateRelaxedTimetable{Problem}(Route);
-          }),
-          std::back_inserter(Result));
+    const auto NewTimetables = getExecutor().map(static_cast<int>(std::size(Routes)), [&](const auto &I) {
+      return CreateRelaxedTimetable{Problem, Deadline}(Routes[I], Timetables[I]);
+    });
 
-      return Result;
-    }();
+    // タイムテーブルが変わった経路だけ、コストを計算し直します。
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+      if (NewTimetables[I] == Timetables[I]) {
+        continue;
+      }
+
+      Working.setTimetable(I, NewTimetables[I]);
+    }
 
-    return sandrokottos::Solution(Routes, Timetables, CalculateCost{Problem}(Routes, Timetables));
+    return std::move(Working).getSolution();
   }
 };
 
@@ -1,45 +1,94 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iterator>
 #include <random>
 #include <ranges>
+#include <stop_token>
+#include <tuple>
+#include <utility>
 #include <vector>
 
-#include <boost/container/small_vector.hpp>
-
+#include "Executor.h"
 #include "Model.h"
+#include "ResequenceRoute.h"
+#include "SolutionBoard.h"
 
 namespace sandrokottos {
 
 // 総走行距離を犠牲にして、積み込み〜配送の総時間を局所探索法で最小化します。
+// シードを複数指定した場合は、温度が異なる複数のレプリカを実行器のタスクとして並列に動かして、ラウンドごとに状態を交換します（レプリカ交換法）。
+// ラウンド内の反復回数は固定なので、締め切りで打ち切られるまでの探索はシードの並びで決まります。
+// 注文の数が少ない経路は、最初にResequenceRouteで順序を最適化します。ResequenceRouteが最適化するのは最も早い時刻での近似のコストなので、その経路も局所探索の対象にします。
+// コストがCalculateLowerBoundで計算した下界に達したら、それ以上は改善できないので、その時点で終了します。
+// レプリカの経路ごとのコストはWorkingSolutionで保持するので、反復ごとに計算し直すのは近傍の経路のコストだけです。
+// SolutionBoardを指定した場合は、ラウンドの終わりに最良解を公開して、公開されたより良いソリューションを最初のレプリカに取り込みながら、停止を要求されるまで探索を続けます。
 
 class OptimizePickupAndDeliveryDuration final {
+  friend class Benchmark;
+
   const sandrokottos::Problem &Problem;
-  std::minstd_rand RandomNumberGenerator;
+  std::vector<unsigned int> Seeds;
+  int ResequencingOrderSize;
 
-  auto getNeighborRoute(const Route &Route) noexcept {
-    const auto Orders = [&] {
-      auto Result = boost::container::small_vector<int, 16>{};
+  struct Replica final {
+    WorkingSolution Solution;
+    std::vector<int> RouteIndices; // 局所探索の対象の経路です。経路ごとの注文の数はソリューションで異なるので、状態の交換ではソリューションと一緒に交換します。
+    double Temperature;
+    std::minstd_rand RandomNumberGenerator;
+    Route NeighborRoute; // 近傍の経路を作成するバッファーです。ラウンド内では、レプリカは1つのタスクだけが使います。
+  };
 
-      std::ranges::copy(
-          Route | std::views::filter([&](const auto &Node) {
-            return Node % 2 == 0;
-          }) | std::views::transform([&](const auto &Node) {
-            return Node / 2;
-          }),
-          std::back_inserter(Result));
+  // ラウンド内の反復回数です。
 
-      return Result;
-    }();
+  static constexpr auto RoundSize = 64;
+
+  // 温度は、最初のレプリカは0（悪化する近傍を受け入れない）で、それ以降は等比数列にします。
+
+  static auto getTemperature(int Index, int Size) noexcept {
+    if (Index == 0) {
+      return 0.0;
+    }
+
+    return Size <= 2 ? 0.5 : 0.5 * std::pow(20.0, static_cast<double>(Index - 1) / (Size - 2));
+  }
+
+  // 積み込み〜配送の総時間を優先して、総走行距離はタイ・ブレークとして使います。
+
+  // 積み込み〜配送の総時間の最適化の、コスト（Score2とScore3）です。
+
+  static auto getDurationCost(const std::tuple<int, int, int> &Cost) noexcept {
+    return std::make_tuple(std::get<1>(Cost), std::get<2>(Cost));
+  }
+
+  static auto getEnergy(const std::tuple<int, int> &Cost) noexcept {
+    return std::get<0>(Cost) + std::get<1>(Cost) / 1'000.0;
+  }
+
+  // 近傍の経路を、呼び出し側が用意したバッファーに作成します。注文がない場合は、空にします。
 
-    if (Orders.empty()) {
-      return sandrokottos::Route{};
+  auto getNeighborRoute(const Route &Route, std::minstd_rand &RandomNumberGenerator, sandrokottos::Route &Result) const noexcept {
+    Result.clear();
+
+    if (Route.empty()) {
+      return;
     }
 
-    const auto Order = Orders[std::uniform_int_distribution<>{0, static_cast<int>(std::size(Orders) - 1)}(RandomNumberGenerator)];
+    // 経路には積み込みと配送が同じ数だけあるので、積み込みの何番目かを選んで、その注文を動かします。
+
+    const auto Order = [&] {
+      auto Index = std::uniform_int_distribution<>{0, static_cast<int>(std::size(Route) / 2 - 1)}(RandomNumberGenerator);
+
+      for (const auto &Node : Route) {
+        if (Node % 2 == 0 && Index-- == 0) {
+          return Node / 2;
+        }
+      }
 
-    auto Result = sandrokottos::Route{};
+      return -1;
+    }();
 
     std::ranges::copy(
         Route | std::views::filter([&](const auto &Node) {
@@ -52,11 +101,9 @@ class OptimizePickupAndDeliveryDuration final {
 
     Result.emplace(std::begin(Result) + PIndex, Order * 2 + 0);
     Result.emplace(std::begin(Result) + DIndex, Order * 2 + 1);
-
-    return Result;
   }
 
-  auto isValidRoute(const int Capacity, const Route &Route) noexcept {
+  auto isValidRoute(const int Capacity, const Route &Route) const noexcept {
     auto Minute = 0;
     auto LuggageSize = 0;
 
@@ -87,65 +134,217 @@ class OptimizePickupAndDeliveryDuration final {
     return true;
   }
 
-  auto getCost(const Route &Route, const Timetable &Timetable) noexcept {
-    auto Score2 = 0;
-    auto Score3 = 0;
+  auto isAccepted(const std::tuple<int, int> &NewCost, const std::tuple<int, int> &Cost, Replica &Replica) const noexcept {
+    if (NewCost <= Cost) {
+      return true;
+    }
 
-    auto LuggageSize = 0;
+    if (Replica.Temperature == 0.0) {
+      return false;
+    }
 
-    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Route)))) {
-      if (I > 0) {
-        Score2 += (Timetable[I] - Timetable[I - 1]) * LuggageSize;
-        Score3 += Problem.getDistanceMatrix()[Route[I - 1]][Route[I]];
+    return std::uniform_real_distribution<>{0.0, 1.0}(Replica.RandomNumberGenerator) < std::exp(-(getEnergy(NewCost) - getEnergy(Cost)) / Replica.Temperature);
+  }
+
+  auto getOrderSize(const Route &Route) const noexcept {
+    return static_cast<int>(std::size(Route) / 2);
+  }
+
+  // 局所探索は、注文が2つ以上の経路を対象にします。注文が1つの経路は、順序が1通りしかないので対象にしません。
+
+  auto getRouteIndices(const WorkingSolution &Solution) const noexcept {
+    auto Result = std::vector<int>{};
+
+    std::ranges::copy(
+        std::views::iota(0, static_cast<int>(std::size(Solution.getRoutes()))) | std::views::filter([&](const auto &I) {
+          return getOrderSize(Solution.getRoutes()[I]) > 1;
+        }),
+        std::back_inserter(Result));
+
+    return Result;
+  }
+
+  // 注文の数が少ない経路の順序を、最も早い時刻での近似のコストで厳密に最適化します。
+
+  auto resequence(WorkingSolution &Solution, const std::chrono::steady_clock::time_point &TimeLimit) const noexcept {
+    const auto &Routes = Solution.getRoutes();
+    const auto &Timetables = Solution.getTimetables();
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+      if (!(std::chrono::steady_clock::now() <= TimeLimit)) {
+        break;
       }
 
-      if (Route[I] % 2 == 0) {
-        LuggageSize++;
+      const auto Route = ResequenceRoute{Problem, ResequencingOrderSize}(Routes[I], Problem.getCapacities()[I]);
 
-        Score2 -= 2; // 次のループで積み込み時間＋移動時間が足されるので、事前に積み込み時間分を減らしておきます。
-      } else {
-        LuggageSize--;
+      if (Route.empty() || Route == Routes[I]) {
+        continue;
       }
+
+      const auto Timetable = CreateStrictTimetable{Problem, TimeLimit}(Route, getMappedTimetable(Routes[I], Timetables[I], Route));
+      const auto NewCost = CalculateRouteCost<AllScores>{Problem}(Route, Timetable);
+
+      if (std::get<0>(NewCost) > std::get<0>(Solution.getRouteCost(I)) || getDurationCost(NewCost) > getDurationCost(Solution.getRouteCost(I))) {
+        continue;
+      }
+
+      Solution.setRoute(I, Route, Timetable, NewCost);
     }
+  }
 
-    return std::make_tuple(Score2, Score3);
+  auto step(Replica &Replica, const std::chrono::steady_clock::time_point &TimeLimit) const noexcept {
+    if (Replica.RouteIndices.empty()) {
+      return;
+    }
+
+    const auto I = Replica.RouteIndices[std::uniform_int_distribution<>{0, static_cast<int>(std::size(Replica.RouteIndices) - 1)}(Replica.RandomNumberGenerator)];
+
+    const auto &Routes = Replica.Solution.getRoutes();
+    const auto &Timetables = Replica.Solution.getTimetables();
+
+    getNeighborRoute(Routes[I], Replica.RandomNumberGenerator, Replica.NeighborRoute);
+
+    const auto &Route = Replica.NeighborRoute;
+
+    if (Route.empty()) {
+      return;
+    }
+
+    if (!isValidRoute(Problem.getCapacities()[I], Route)) {
+      return;
+    }
+
+    // 移動前の経路のタイムテーブルをヒントにします。移動しなかった注文の時刻は、ほとんど変わりません。
+
+    // isValidRouteを満たす経路なら、CP-SATが時間切れの場合の（最も早い時刻の）タイムテーブルも希望配送時間を満たします。
+
+    const auto Timetable = CreateStrictTimetable{Problem, TimeLimit}(Route, getMappedTimetable(Routes[I], Timetables[I], Route));
+
+    // 移動前の経路のコストは、保持しているものを使います。
+
+    const auto NewCost = CalculateRouteCost<AllScores>{Problem}(Route, Timetable);
+
+    // 部分点で配送している注文がある場合は、Score1が悪化する近傍は受け入れません。
+
+    if (std::get<0>(NewCost) > std::get<0>(Replica.Solution.getRouteCost(I))) {
+      return;
+    }
+
+    if (!isAccepted(getDurationCost(NewCost), getDurationCost(Replica.Solution.getRouteCost(I)), Replica)) {
+      return;
+    }
+
+    Replica.Solution.setRoute(I, Route, Timetable, NewCost);
   }
 
 public:
-  explicit OptimizePickupAndDeliveryDuration(const sandrokottos::Problem &Problem) noexcept : Problem{Problem}, RandomNumberGenerator{0} {}
+  explicit OptimizePickupAndDeliveryDuration(const sandrokottos::Problem &Problem, const std::vector<unsigned int> &Seeds = {0}, int ResequencingOrderSize = 6) noexcept
+      : Problem{Problem}, Seeds{Seeds}, ResequencingOrderSize{ResequencingOrderSize} {}
 
-  auto operator()(const Solution &Solution, const std::chrono::steady_clock::time_point &TimeLimit) noexcept {
-    auto Routes = Solution.getRoutes();
-    auto Timetables = Solution.getTimetables();
+  auto operator()(const Solution &Solution, const std::tuple<int, int, int> &LowerBound, const std::chrono::steady_clock::time_point &TimeLimit, SolutionBoard *Board = nullptr, std::stop_token StopToken = {}) const noexcept {
+    auto Working = WorkingSolution{Problem, Solution};
 
-    while (std::chrono::steady_clock::now() <= TimeLimit) {
-      const auto I = std::uniform_int_distribution<>{0, static_cast<int>(std::size(Routes) - 1)}(RandomNumberGenerator);
+    resequence(Working, TimeLimit);
 
-      const auto Route = getNeighborRoute(Routes[I]);
+    // Score1も含めて下界と比較します。取り込んだソリューションのScore1は、入力と異なる場合があります。
 
-      if (Route.empty()) {
-        continue;
+    const auto IsOptimal = [&](const WorkingSolution &Solution) {
+      return Solution.getCost() <= LowerBound;
+    };
+
+    const auto IsStopped = [&] {
+      return !(std::chrono::steady_clock::now() <= TimeLimit) || StopToken.stop_requested();
+    };
+
+    if (IsOptimal(Working) || getRouteIndices(Working).empty()) {
+      return std::move(Working).getSolution();
+    }
+
+    const auto ReplicaSize = static_cast<int>(std::size(Seeds));
+
+    auto Replicas = [&] {
+      auto Result = std::vector<Replica>{};
+
+      for (const auto &I : std::views::iota(0, ReplicaSize)) {
+        Result.emplace_back(Replica{Working, getRouteIndices(Working), getTemperature(I, ReplicaSize), std::minstd_rand{Seeds[I]}, Route{}});
       }
 
-      if (!isValidRoute(Problem.getCapacities()[I], Route)) {
-        continue;
+      return Result;
+    }();
+
+    auto Best = std::move(Working);
+
+    // 最後に確認したSolutionBoardのバージョンです。
+
+    auto Version = Board ? Board->getVersion() : 0;
+
+    // 交換の判定に使う乱数生成器です。交換の結果もシードの並びで決まるように、最初のシードから作成します。
+
+    auto RandomNumberGenerator = std::minstd_rand{Seeds.front()};
+
+    for (auto Round = 0;; ++Round) {
+      // レプリカごとのラウンドを、実行器のタスクとして並列に実行します。
+
+      getExecutor().map(ReplicaSize, [&](const auto &I) {
+        for (auto J = 0; J < RoundSize && std::chrono::steady_clock::now() <= TimeLimit; ++J) {
+          step(Replicas[I], TimeLimit);
+        }
+      });
+
+      // ラウンドの終わりに、最良解を更新して、隣り合う温度のレプリカの状態を交換します。
+
+      const auto IsImproved = [&] {
+        auto Result = false;
+
+        for (const auto &Replica : Replicas) {
+          if (Replica.Solution.getCost() < Best.getCost()) {
+            Best = Replica.Solution;
+            Result = true;
+          }
+        }
+
+        return Result;
+      }();
+
+      if (Board && IsImproved) {
+        Board->publish(Best.getSolution());
       }
 
-      const auto Timetable = CreateStrictTimetable{Problem}(Route);
+      for (auto I = Round % 2; I + 1 < ReplicaSize; I += 2) {
+        const auto Beta1 = 1.0 / std::max(Replicas[I + 0].Temperature, 1e-9);
+        const auto Beta2 = 1.0 / std::max(Replicas[I + 1].Temperature, 1e-9);
 
-      if (Timetable.empty()) {
-        continue;
+        const auto Delta = (Beta1 - Beta2) * (getEnergy(getDurationCost(Replicas[I + 0].Solution.getCost())) - getEnergy(getDurationCost(Replicas[I + 1].Solution.getCost())));
+
+        if (Delta >= 0 || std::uniform_real_distribution<>{0.0, 1.0}(RandomNumberGenerator) < std::exp(Delta)) {
+          std::swap(Replicas[I + 0].Solution, Replicas[I + 1].Solution);
+          std::swap(Replicas[I + 0].RouteIndices, Replicas[I + 1].RouteIndices);
+        }
       }
 
-      if (getCost(Route, Timetable) > getCost(Routes[I], Timetables[I])) {
-        continue;
+      // 他のタスクが公開したより良いソリューションを、最初のレプリカに取り込みます。自分が公開したソリューションは、最良解より良くならないので取り込みません。
+
+      if (Board && Board->getVersion() != Version) {
+        Version = Board->getVersion();
+
+        if (const auto Incumbent = Board->get(); Incumbent->getCost() < Best.getCost()) {
+          auto Incoming = WorkingSolution{Problem, *Incumbent};
+
+          resequence(Incoming, TimeLimit);
+
+          Replicas.front().RouteIndices = getRouteIndices(Incoming);
+          Replicas.front().Solution = Incoming;
+
+          Best = std::move(Incoming);
+        }
       }
 
-      Routes[I] = Route;
-      Timetables[I] = Timetable;
+      if (IsStopped() || IsOptimal(Best)) {
+        break;
+      }
     }
 
-    return sandrokottos::Solution(Routes, Timetables, CalculateCost{Problem}(Routes, Timetables));
+    return std::move(Best).getSolution();
   }
 };
 
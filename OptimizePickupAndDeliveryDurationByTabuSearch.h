@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <ranges>
+#include <tuple>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
+
+#include "Model.h"
+
+namespace sandrokottos {
+
+// 積み込み〜配送の総時間を、タブー・サーチで最小化します。近傍は、OptimizePickupAndDeliveryDurationと同じ経路内での注文の移動です。
+//
+//   候補: 注文の積み込みと配送を、それぞれ移動時間が近いK個のノードの直後（と経路の先頭）に挿入する組み合わせだけを評価します。
+//   評価: CP-SATは使わずに、配送時刻を変えない範囲で積み込みをできるだけ遅らせるタイムテーブルで比較します。CP-SATは、採用した経路にだけ使います。
+//   記憶: 経路は、辺ごとの乱数のXORでハッシュします（Zobristハッシュ）。注文の移動で変わる辺は高々6本なので、差分で更新できます。
+//         最近の経路のハッシュを固定長のタブー・リストに記録して、タブーな経路には、その経路の最良のコストを更新する場合（アスピレーション）を除いて移動しません。
+//         CP-SATで作成したタイムテーブルも、ハッシュをキーに固定長の表に記録して、同じ経路で再計算しないようにします。
+
+class OptimizePickupAndDeliveryDurationByTabuSearch final {
+  friend class Benchmark;
+
+  const sandrokottos::Problem &Problem;
+  int CandidateSize;
+  int TabuTenure;
+
+  // ノードごとの乱数です。最後の要素は、経路の先頭の前と末尾の後を表現する仮想のノードです。
+
+  std::vector<std::uint64_t> Keys;
+
+  static constexpr auto TabuTableSize = 1 << 12;
+  static constexpr auto TimetableTableSize = 1 << 12;
+
+  struct TabuEntry final {
+    std::uint64_t Hash = 0;
+    int Iteration = 0;
+  };
+
+  struct TimetableEntry final {
+    std::uint64_t Hash = 0;
+    sandrokottos::Timetable Timetable;
+  };
+
+  auto getVirtualNode() const noexcept {
+    return Problem.getOrderSize() * 2;
+  }
+
+  // 辺ごとの乱数です。ノードの数の2乗の表は大きすぎるので、ノードごとの乱数を混ぜて作成します。
+  // 単純にXORすると、経路のハッシュが辺の並びによらず一定になってしまうので、SplitMix64と同じ方法で非線形に混ぜます。
+
+  auto getArcKey(int From, int To) const noexcept {
+    auto Result = Keys[From] + std::rotl(Keys[To], 1);
+
+    Result = (Result ^ (Result >> 30)) * 0xbf58476d1ce4e5b9;
+    Result = (Result ^ (Result >> 27)) * 0x94d049bb133111eb;
+
+    return Result ^ (Result >> 31);
+  }
+
+  auto getHash(const Route &Route) const noexcept {
+    auto Result = std::uint64_t{0};
+
+    auto From = getVirtualNode();
+
+    for (const auto &To : Route) {
+      Result ^= getArcKey(From, To);
+      From = To;
+    }
+
+    return Result ^ getArcKey(From, getVirtualNode());
+  }
+
+  // 経路のI番目のノードです。範囲外の場合は、仮想のノードです。
+
+  auto getNode(const Route &Route, int I) const noexcept {
+    return I < 0 || I >= static_cast<int>(std::size(Route)) ? getVirtualNode() : Route[I];
+  }
+
+  // 配送時刻を変えずに、積み込みをできるだけ遅くしたタイムテーブルを作成します。実行できない経路の場合は、空にします。
+  // できるだけ早い時刻で作成してから、最後のノードから逆順に、次のノードに間に合う最も遅い時刻に変更します。
+
+  auto getProxyTimetable(const Route &Route, int Capacity, Timetable &Result) const noexcept {
+    Result.clear();
+
+    auto Minute = 0;
+    auto LuggageSize = 0;
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Route)))) {
+      if (I > 0) {
+        Minute += Problem.getDurationMatrix()[Route[I - 1]][Route[I]];
+      }
+
+      if (Route[I] % 2 == 0) {
+        if (++LuggageSize > Capacity) { // キャパシティーを超えて積み込むことはできません。
+          Result.clear();
+          return false;
+        }
+      } else {
+        const auto &[Lower, Upper] = Problem.getTimeWindows()[Route[I] / 2];
+
+        Minute = std::max(Minute, std::max(30, Lower));
+
+        if (Minute > Upper || Minute > 150 - 2) { // 希望配送時間を超えてはならず、13:00の2分前までに配送しなければなりません。
+          Result.clear();
+          return false;
+        }
+
+        LuggageSize--;
+      }
+
+      Result.emplace_back(Minute);
+    }
+
+    for (auto I = static_cast<int>(std::size(Route)) - 2; I >= 0; --I) {
+      if (Route[I] % 2 != 0) {
+        continue;
+      }
+
+      Result[I] = std::max(Result[I], Result[I + 1] - Problem.getDurationMatrix()[Route[I]][Route[I + 1]]);
+    }
+
+    return true;
+  }
+
+  // 経路から注文を取り除いた経路と、そのハッシュを作成します。
+
+  auto getReducedRoute(const Route &Route, std::uint64_t Hash, int Order, sandrokottos::Route &Result) const noexcept {
+    const auto PIndex = static_cast<int>(std::distance(std::begin(Route), std::ranges::find(Route, Order * 2 + 0)));
+    const auto DIndex = static_cast<int>(std::distance(std::begin(Route), std::ranges::find(Route, Order * 2 + 1)));
+
+    if (DIndex == PIndex + 1) {
+      Hash ^= getArcKey(getNode(Route, PIndex - 1), Order * 2 + 0) ^ getArcKey(Order * 2 + 0, Order * 2 + 1) ^ getArcKey(Order * 2 + 1, getNode(Route, DIndex + 1)) ^ getArcKey(getNode(Route, PIndex - 1), getNode(Route, DIndex + 1));
+    } else {
+      Hash ^= getArcKey(getNode(Route, PIndex - 1), Order * 2 + 0) ^ getArcKey(Order * 2 + 0, getNode(Route, PIndex + 1)) ^ getArcKey(getNode(Route, PIndex - 1), getNode(Route, PIndex + 1));
+      Hash ^= getArcKey(getNode(Route, DIndex - 1), Order * 2 + 1) ^ getArcKey(Order * 2 + 1, getNode(Route, DIndex + 1)) ^ getArcKey(getNode(Route, DIndex - 1), getNode(Route, DIndex + 1));
+    }
+
+    Result.clear();
+
+    std::ranges::copy(
+        Route | std::views::filter([&](const auto &Node) {
+          return Node / 2 != Order;
+        }),
+        std::back_inserter(Result));
+
+    return Hash;
+  }
+
+  // 注文を取り除いた経路に、積み込みをPIndex番目、配送をDIndex番目になるように挿入した経路のハッシュです。
+
+  auto getInsertedHash(const Route &ReducedRoute, std::uint64_t Hash, int Order, int PIndex, int DIndex) const noexcept {
+    if (DIndex == PIndex + 1) {
+      const auto A = getNode(ReducedRoute, PIndex - 1);
+      const auto B = getNode(ReducedRoute, PIndex);
+
+      return Hash ^ getArcKey(A, B) ^ getArcKey(A, Order * 2 + 0) ^ getArcKey(Order * 2 + 0, Order * 2 + 1) ^ getArcKey(Order * 2 + 1, B);
+    }
+
+    const auto A = getNode(ReducedRoute, PIndex - 1);
+    const auto B = getNode(ReducedRoute, PIndex);
+    const auto C = getNode(ReducedRoute, DIndex - 2);
+    const auto D = getNode(ReducedRoute, DIndex - 1);
+
+    return Hash ^ getArcKey(A, B) ^ getArcKey(A, Order * 2 + 0) ^ getArcKey(Order * 2 + 0, B) ^ getArcKey(C, D) ^ getArcKey(C, Order * 2 + 1) ^ getArcKey(Order * 2 + 1, D);
+  }
+
+  // Nodeへの移動時間が短い順に、経路のノードの位置をCandidateSize個リターンします。先頭に挿入する候補として、-1を必ず含めます。
+
+  auto getNearPositions(const Route &Route, int Node) const noexcept {
+    auto Result = boost::container::small_vector<int, 16>{};
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Route)))) {
+      Result.emplace_back(I);
+    }
+
+    const auto Size = std::min(CandidateSize, static_cast<int>(std::size(Result)));
+
+    std::ranges::partial_sort(Result, std::begin(Result) + Size, [&](const auto &I, const auto &J) {
+      return Problem.getDurationMatrix()[Route[I]][Node] < Problem.getDurationMatrix()[Route[J]][Node];
+    });
+
+    Result.resize(Size);
+    Result.emplace_back(-1);
+
+    return Result;
+  }
+
+public:
+  explicit OptimizePickupAndDeliveryDurationByTabuSearch(const sandrokottos::Problem &Problem, int CandidateSize = 4, int TabuTenure = 32) noexcept
+      : Problem{Problem}, CandidateSize{CandidateSize}, TabuTenure{TabuTenure} {
+    auto RandomNumberGenerator = std::mt19937_64{0};
+
+    for (auto I = 0; I < Problem.getOrderSize() * 2 + 1; ++I) {
+      Keys.emplace_back(RandomNumberGenerator());
+    }
+  }
+
+  auto operator()(const Solution &Solution, const std::chrono::steady_clock::time_point &TimeLimit) const noexcept {
+    auto Routes = Solution.getRoutes();
+    auto Timetables = Solution.getTimetables();
+
+    auto BestRoutes = Routes;
+    auto BestTimetables = Timetables;
+
+    // 経路ごとの、現在のハッシュとコスト、最良のコストです。
+
+    auto Hashes = std::vector<std::uint64_t>{};
+    auto Costs = std::vector<std::tuple<int, int>>{};
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+      Hashes.emplace_back(getHash(Routes[I]));
+      Costs.emplace_back(CalculateRouteCost<DurationScores>{Problem}(Routes[I], Timetables[I]));
+    }
+
+    auto BestCosts = Costs;
+
+    auto TabuTable = std::vector<TabuEntry>(TabuTableSize);
+    auto TimetableTable = std::vector<TimetableEntry>(TimetableTableSize);
+
+    const auto IsTabu = [&](std::uint64_t Hash, int Iteration) {
+      const auto &Entry = TabuTable[Hash % TabuTableSize];
+
+      return Entry.Hash == Hash && Iteration - Entry.Iteration <= TabuTenure;
+    };
+
+    // 候補の評価に使うバッファーです。
+
+    auto ReducedRoute = Route{};
+    auto CandidateRoute = Route{};
+    auto CandidateTimetable = Timetable{};
+
+    for (auto Iteration = 0; std::chrono::steady_clock::now() <= TimeLimit; ++Iteration) {
+      auto IsMoved = false;
+
+      for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+        if (std::size(Routes[I]) < 4 || !(std::chrono::steady_clock::now() <= TimeLimit)) {
+          continue;
+        }
+
+        // タブーではない（もしくはアスピレーションを満たす）候補の中から、最良の候補を選びます。
+
+        auto Best = std::make_tuple(std::make_tuple(std::numeric_limits<int>::max(), std::numeric_limits<int>::max()), std::uint64_t{0}, -1, 0, 0);
+
+        for (const auto &Node : Routes[I]) {
+          if (Node % 2 != 0) {
+            continue;
+          }
+
+          const auto Order = Node / 2;
+          const auto ReducedHash = getReducedRoute(Routes[I], Hashes[I], Order, ReducedRoute);
+
+          for (const auto &PPosition : getNearPositions(ReducedRoute, Order * 2 + 0)) {
+            const auto PIndex = PPosition + 1;
+
+            for (const auto &DPosition : getNearPositions(ReducedRoute, Order * 2 + 1)) {
+              const auto DIndex = std::max(DPosition + 2, PIndex + 1);
+
+              if (DPosition + 2 < PIndex + 1 && DPosition >= 0) { // 積み込みより前に配送することはできないので、直後に配送する候補（DPosition == -1）にまとめます。
+                continue;
+              }
+
+              const auto Hash = getInsertedHash(ReducedRoute, ReducedHash, Order, PIndex, DIndex);
+
+              if (Hash == Hashes[I]) {
+                continue;
+              }
+
+              getInsertedRoute(ReducedRoute, Order, PIndex, DIndex, CandidateRoute);
+
+              if (!getProxyTimetable(CandidateRoute, Problem.getCapacities()[I], CandidateTimetable)) {
+                continue;
+              }
+
+              const auto Cost = CalculateRouteCost<DurationScores>{Problem}(CandidateRoute, CandidateTimetable);
+
+              if (IsTabu(Hash, Iteration) && !(Cost < BestCosts[I])) {
+                continue;
+              }
+
+              if (Cost < std::get<0>(Best)) {
+                Best = std::make_tuple(Cost, Hash, Order, PIndex, DIndex);
+              }
+            }
+          }
+        }
+
+        const auto &[_, Hash, Order, PIndex, DIndex] = Best;
+
+        if (Order < 0) {
+          continue;
+        }
+
+        // 悪化する場合でも移動して、移動前の経路をタブーにします。
+
+        TabuTable[Hashes[I] % TabuTableSize] = TabuEntry{Hashes[I], Iteration};
+
+        getReducedRoute(Routes[I], Hashes[I], Order, ReducedRoute);
+        getInsertedRoute(ReducedRoute, Order, PIndex, DIndex, Routes[I]);
+
+        Timetables[I] = [&] {
+          auto &Entry = TimetableTable[Hash % TimetableTableSize];
+
+          // 比較に使ったタイムテーブルも実行可能なので、CP-SATの結果（時間切れの場合もあります）の方が悪ければ、比較に使ったタイムテーブルを使います。
+
+          if (Entry.Hash != Hash || Entry.Timetable.empty()) {
+            getProxyTimetable(Routes[I], Problem.getCapacities()[I], CandidateTimetable);
+
+            const auto Timetable = CreateStrictTimetable{Problem, TimeLimit}(Routes[I], CandidateTimetable);
+
+            const auto IsBetter = CalculateRouteCost<DurationScores>{Problem}(Routes[I], Timetable) <= CalculateRouteCost<DurationScores>{Problem}(Routes[I], CandidateTimetable);
+
+            Entry = TimetableEntry{Hash, IsBetter ? Timetable : CandidateTimetable};
+          }
+
+          return Entry.Timetable;
+        }();
+
+        Hashes[I] = Hash;
+        Costs[I] = CalculateRouteCost<DurationScores>{Problem}(Routes[I], Timetables[I]);
+
+        IsMoved = true;
+
+        if (Costs[I] < BestCosts[I]) {
+          BestRoutes[I] = Routes[I];
+          BestTimetables[I] = Timetables[I];
+          BestCosts[I] = Costs[I];
+        }
+      }
+
+      if (!IsMoved) {
+        break;
+      }
+    }
+
+    return sandrokottos::Solution(BestRoutes, BestTimetables, CalculateCost{Problem}(BestRoutes, BestTimetables));
+  }
+};
+
+} // namespace sandrokottos
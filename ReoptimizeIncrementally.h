@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <ranges>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "Executor.h"
+#include "Model.h"
+
+namespace sandrokottos {
+
+// 実行中の計画に、後から届いた注文を追加します。
+// 指定した時刻より前の積み込みや配送は実行済みとして固定して、それ以降の部分にだけ、OptimizeOrderSizeと同じやり方で注文を挿入します。
+// キャンセルされた注文のうち、固定した部分で積み込んで配送していない荷物（convertToSolutionを参照）は、ロボットに積まれたままとしてキャパシティーから差し引きます。
+// 挿入の候補は、挿入前の経路も同じやり方で作成したタイムテーブルのコストと比較して、最後に、挿入した経路の固定した部分より後のタイムテーブルをCreateRelaxedTimetableで作り直します。
+
+class ReoptimizeIncrementally final {
+  const sandrokottos::Problem &Problem;
+
+  // 固定した部分は以前のタイムテーブルのままにして、それ以降をできるだけ早い時刻（配送は希望配送時間の始まりまで待ちます）で、呼び出し側が用意したバッファーに作成します。
+  // 固定した部分より後は、キャンセルされた注文の荷物（CancelledLuggageSize）も積んでいるものとして、キャパシティーを確認します。
+  // 経路の最後まで積み込みや配送ができる場合だけ、trueをリターンします。
+
+  auto getNewTimetable(const Route &Route, const Timetable &FrozenTimetable, int FrozenSize, int FrozenMinute, int CancelledLuggageSize, int RIndex, Timetable &Result) const noexcept {
+    Result.clear();
+
+    auto Minute = 0;
+    auto LuggageSize = 0;
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Route)))) {
+      if (I < FrozenSize) {
+        Minute = FrozenTimetable[I];
+      } else {
+        if (I > 0) {
+          Minute += Problem.getDurationMatrix()[Route[I - 1]][Route[I]];
+        }
+
+        Minute = std::max(Minute, FrozenMinute); // 過去に積み込みや配送をすることはできません。
+
+        if (Route[I] % 2 != 0) {
+          Minute = std::max(Minute, std::max(30, std::get<0>(Problem.getTimeWindows()[Route[I] / 2])));
+        }
+
+        if (Minute > 150 - 2) { // 13:00の2分前までに配送しなければなりません。
+          return false;
+        }
+      }
+
+      Result.emplace_back(Minute);
+
+      if (Route[I] % 2 == 0) {
+        if (++LuggageSize + (I >= FrozenSize ? CancelledLuggageSize : 0) > Problem.getCapacities()[RIndex]) { // キャパシティーを超えて積み込むことはできません。
+          return false;
+        }
+      } else {
+        LuggageSize--;
+      }
+    }
+
+    return true;
+  }
+
+public:
+  explicit ReoptimizeIncrementally(const sandrokottos::Problem &Problem) noexcept : Problem{Problem} {}
+
+  auto operator()(const Solution &Solution, int FrozenMinute, const std::vector<int> &CancelledLuggageSizes, const std::chrono::steady_clock::time_point &TimeLimit, const std::chrono::steady_clock::time_point &Deadline) const noexcept {
+    auto Working = WorkingSolution{Problem, Solution};
+
+    const auto &Routes = Working.getRoutes();
+    const auto &Timetables = Working.getTimetables();
+
+    // 固定する（指定した時刻より前の）部分の長さを、経路単位で求めておきます。
+
+    const auto FrozenSizes = [&] {
+      auto Result = std::vector<int>{};
+
+      std::ranges::copy(
+          Timetables | std::views::transform([&](const auto &Timetable) {
+            return static_cast<int>(std::distance(std::begin(Timetable), std::ranges::find_if(Timetable, [&](const auto &Minute) {
+                                                    return Minute >= FrozenMinute;
+                                                  })));
+          }),
+          std::back_inserter(Result));
+
+      return Result;
+    }();
+
+    // どの経路にも含まれていない注文（新しく届いた注文と、以前は配送できなかった注文）を、挿入の候補にします。
+
+    auto Orders = [&] {
+      auto Result = std::vector<int>{};
+
+      std::ranges::copy(
+          std::views::iota(0, Problem.getOrderSize()),
+          std::back_inserter(Result));
+
+      for (const auto &Route : Routes) {
+        for (const auto &Node : Route) {
+          if (Node % 2 != 0) {
+            continue;
+          }
+
+          std::erase(Result, Node / 2);
+        }
+      }
+
+      return Result;
+    }();
+
+    // 挿入前の経路のコストです。以前のタイムテーブル（CP-SATで作成したもの）のコストと比較すると挿入の良し悪しを判断できないので、挿入後と同じやり方で作成したタイムテーブルで計算します。
+    // そのやり方でタイムテーブルを作成できない経路は、保持しているコストを使います。
+
+    auto NewTimetable = sandrokottos::Timetable{};
+
+    auto Costs = [&] {
+      auto Result = std::vector<std::tuple<int, int, int>>{};
+
+      for (const auto &RIndex : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+        Result.emplace_back(getNewTimetable(Routes[RIndex], Timetables[RIndex], FrozenSizes[RIndex], FrozenMinute, CancelledLuggageSizes[RIndex], RIndex, NewTimetable) ? CalculateRouteCost<AllScores>{Problem}(Routes[RIndex], NewTimetable) : Working.getRouteCost(RIndex));
+      }
+
+      return Result;
+    }();
+
+    // 注文を挿入した経路です。最後に、タイムテーブルを作り直します。
+
+    auto IsInserted = std::vector<bool>(std::size(Routes), false);
+
+    while (!Orders.empty() && std::chrono::steady_clock::now() <= TimeLimit) {
+      const auto [Order, I, Route, Timetable] = [&] {
+        auto Result = std::make_tuple(-1, 0, sandrokottos::Route{}, sandrokottos::Timetable{});
+
+        auto BestDelta = std::make_tuple(0, 0, 0);
+
+        auto NewRoute = sandrokottos::Route{};
+
+        for (const auto &Order : Orders) {
+          if (!(std::chrono::steady_clock::now() <= TimeLimit)) {
+            return Result;
+          }
+
+          for (const auto &RIndex : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+            const auto &Cost = Costs[RIndex];
+
+            for (const auto &PIndex : std::views::iota(FrozenSizes[RIndex], static_cast<int>(std::size(Routes[RIndex]) + 1))) {
+              for (const auto &DIndex : std::views::iota(PIndex + 1, static_cast<int>(std::size(Routes[RIndex]) + 2))) {
+                getInsertedRoute(Routes[RIndex], Order, PIndex, DIndex, NewRoute);
+
+                if (!getNewTimetable(NewRoute, Timetables[RIndex], FrozenSizes[RIndex], FrozenMinute, CancelledLuggageSizes[RIndex], RIndex, NewTimetable)) {
+                  continue;
+                }
+
+                const auto NewCost = CalculateRouteCost<AllScores>{Problem}(NewRoute, NewTimetable);
+                const auto Delta = std::make_tuple(std::get<0>(NewCost) - std::get<0>(Cost), std::get<1>(NewCost) - std::get<1>(Cost), std::get<2>(NewCost) - std::get<2>(Cost));
+
+                if (Delta < BestDelta) {
+                  BestDelta = Delta;
+                  Result = std::make_tuple(Order, RIndex, NewRoute, NewTimetable);
+                }
+              }
+            }
+          }
+        }
+
+        return Result;
+      }();
+
+      if (Order < 0) {
+        break;
+      }
+
+      std::erase(Orders, Order);
+
+      Working.setRoute(I, Route, Timetable);
+
+      Costs[I] = Working.getRouteCost(I);
+      IsInserted[I] = true;
+    }
+
+    // 挿入した経路の、固定した部分より後のタイムテーブルを、挿入の際に作成したタイムテーブルをヒントにして並列に作り直します。
+
+    const auto NewTimetables = getExecutor().map(static_cast<int>(std::size(Routes)), [&](const auto &I) {
+      return IsInserted[I] ? CreateRelaxedTimetable{Problem, Deadline}(Routes[I], Timetables[I], FrozenSizes[I], FrozenMinute) : Timetables[I];
+    });
+
+    for (const auto &I : std::views::iota(0, static_cast<int>(std::size(Routes)))) {
+      if (NewTimetables[I] == Timetables[I]) {
+        continue;
+      }
+
+      Working.setTimetable(I, NewTimetables[I]);
+    }
+
+    return std::move(Working).getSolution();
+  }
+};
+
+} // namespace sandrokottos
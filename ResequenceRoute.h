@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <ranges>
+#include <tuple>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
+
+#include "Model.h"
+
+namespace sandrokottos {
+
+// 注文の数が少ない経路の、積み込みと配送の順序を動的計画法で厳密に最適化します。
+// 状態は注文ごとの進捗（未積み込み、積み込み済み、配送済み）を3進数で表現した値と最後に訪問したノードで、
+// 時刻はOptimizePickupAndDeliveryDuration::isValidRouteと同じ（配送は希望配送時間の開始まで待つ）規則で計算します。
+// コストは、その時刻での（積み込み〜配送の総時間, 総走行距離）です。
+
+class ResequenceRoute final {
+  const sandrokottos::Problem &Problem;
+  int MaxOrderSize;
+
+  // 状態に到達するまでの計算結果です。Parentは、ひとつ前のラベルの位置です。
+
+  struct Label final {
+    int Minute;
+    int Score2;
+    int Score3;
+    int Node;
+    int Parent;
+  };
+
+  // Aの方が早く到達していて、この先をどのように進んでもBよりコストが悪くならないなら、AはBを支配します。
+  // Aの方が早い分だけ、この先の積み込みが早くなって積み込み〜配送の時間が延びる可能性があるので、その最大値を加えて比較します。
+
+  static auto isDominated(const Label &A, const Label &B, int Slope) noexcept {
+    if (A.Minute > B.Minute) {
+      return false;
+    }
+
+    const auto Score2 = A.Score2 + Slope * (B.Minute - A.Minute);
+
+    return Score2 < B.Score2 || (Score2 == B.Score2 && A.Score3 <= B.Score3);
+  }
+
+public:
+  explicit ResequenceRoute(const sandrokottos::Problem &Problem, int MaxOrderSize = 6) noexcept : Problem{Problem}, MaxOrderSize{MaxOrderSize} {}
+
+  auto getMaxOrderSize() const noexcept {
+    return MaxOrderSize;
+  }
+
+  // 最適な経路をリターンします。注文の数が多すぎる場合や実行可能な順序がない場合は、空の経路をリターンします。
+
+  auto operator()(const Route &Route, int Capacity) const noexcept {
+    const auto Orders = [&] {
+      auto Result = boost::container::small_vector<int, 16>{};
+
+      std::ranges::copy(
+          Route | std::views::filter([&](const auto &Node) {
+            return Node % 2 == 0;
+          }) | std::views::transform([&](const auto &Node) {
+            return Node / 2;
+          }),
+          std::back_inserter(Result));
+
+      return Result;
+    }();
+
+    const auto OrderSize = static_cast<int>(std::size(Orders));
+
+    if (OrderSize == 0 || OrderSize > MaxOrderSize) {
+      return sandrokottos::Route{};
+    }
+
+    // 3のべき乗を計算しておきます。
+
+    const auto Powers = [&] {
+      auto Result = boost::container::small_vector<int, 16>{1};
+
+      for (auto I = 0; I < OrderSize; ++I) {
+        Result.emplace_back(Result.back() * 3);
+      }
+
+      return Result;
+    }();
+
+    const auto StatusSize = Powers[OrderSize];
+    const auto NodeSize = OrderSize * 2 + 1; // 最後のノードは、まだどこも訪問していないことを表現します。
+
+    auto Labels = std::vector<Label>{Label{0, 0, 0, OrderSize * 2, -1}};
+    auto Buckets = std::vector<std::vector<int>>(static_cast<std::size_t>(StatusSize) * NodeSize);
+
+    Buckets[OrderSize * 2].emplace_back(0);
+
+    // 進捗を表現する値は遷移で必ず増えるので、小さい順に処理すれば、前の状態はすべて処理済みになります。
+
+    for (auto Status = 0; Status < StatusSize; ++Status) {
+      const auto [LuggageSize, RemainingPickupSize] = [&] {
+        auto Result = std::make_tuple(0, 0);
+
+        for (auto I = 0; I < OrderSize; ++I) {
+          const auto Digit = Status / Powers[I] % 3;
+
+          std::get<0>(Result) += Digit == 1;
+          std::get<1>(Result) += Digit == 0;
+        }
+
+        return Result;
+      }();
+
+      for (auto Last = 0; Last < NodeSize; ++Last) {
+        for (const auto &LabelIndex : Buckets[static_cast<std::size_t>(Status) * NodeSize + Last]) {
+          for (auto Next = 0; Next < OrderSize * 2; ++Next) {
+            const auto I = Next / 2;
+            const auto Digit = Status / Powers[I] % 3;
+            const auto IsPickup = Next % 2 == 0;
+
+            if (Digit != (IsPickup ? 0 : 1)) {
+              continue;
+            }
+
+            if (IsPickup && LuggageSize + 1 > Capacity) { // キャパシティーを超えて積み込むことはできません。
+              continue;
+            }
+
+            const auto &Current = Labels[LabelIndex];
+
+            const auto FromNode = Last == OrderSize * 2 ? -1 : Orders[Last / 2] * 2 + Last % 2;
+            const auto ToNode = Orders[I] * 2 + Next % 2;
+
+            auto Minute = Current.Minute + (FromNode < 0 ? 0 : Problem.getDurationMatrix()[FromNode][ToNode]);
+
+            if (!IsPickup) {
+              const auto &[Lower, Upper] = Problem.getTimeWindows()[Orders[I]];
+
+              Minute = std::max(Minute, std::max(30, Lower));
+
+              if (Minute > Upper || Minute > 150 - 2) { // 希望配送時間を超えてはならず、13:00の2分前までに配送しなければなりません。
+                continue;
+              }
+            }
+
+            const auto NewLabel = Label{
+                Minute,
+                Current.Score2 + (Minute - Current.Minute) * LuggageSize - (IsPickup ? 2 : 0),
+                Current.Score3 + (FromNode < 0 ? 0 : Problem.getDistanceMatrix()[FromNode][ToNode]),
+                ToNode,
+                LabelIndex};
+
+            const auto NewStatus = Status + Powers[I];
+            const auto NewLuggageSize = LuggageSize + (IsPickup ? 1 : -1);
+            const auto NewRemainingPickupSize = RemainingPickupSize - (IsPickup ? 1 : 0);
+
+            auto &Bucket = Buckets[static_cast<std::size_t>(NewStatus) * NodeSize + Next];
+
+            const auto Slope = NewLuggageSize + NewRemainingPickupSize;
+
+            if (std::ranges::any_of(Bucket, [&](const auto &Index) { return isDominated(Labels[Index], NewLabel, Slope); })) {
+              continue;
+            }
+
+            std::erase_if(Bucket, [&](const auto &Index) { return isDominated(NewLabel, Labels[Index], Slope); });
+
+            Bucket.emplace_back(static_cast<int>(std::size(Labels)));
+            Labels.emplace_back(NewLabel);
+          }
+        }
+      }
+    }
+
+    // すべての注文を配送済みの状態から、最良のラベルを選びます。
+
+    const auto Best = [&] {
+      auto Result = -1;
+
+      for (auto Last = 0; Last < OrderSize * 2; ++Last) {
+        for (const auto &Index : Buckets[static_cast<std::size_t>(StatusSize - 1) * NodeSize + Last]) {
+          if (Result < 0 || std::make_tuple(Labels[Index].Score2, Labels[Index].Score3) < std::make_tuple(Labels[Result].Score2, Labels[Result].Score3)) {
+            Result = Index;
+          }
+        }
+      }
+
+      return Result;
+    }();
+
+    if (Best < 0) {
+      return sandrokottos::Route{};
+    }
+
+    // ラベルを逆にたどって、経路を作成します。
+
+    auto Result = sandrokottos::Route{};
+
+    for (auto Index = Best; Labels[Index].Parent >= 0; Index = Labels[Index].Parent) {
+      Result.emplace_back(Labels[Index].Node);
+    }
+
+    std::ranges::reverse(Result);
+
+    return Result;
+  }
+};
+
+} // namespace sandrokottos
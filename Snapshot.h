@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "IO.h"
+#include "Model.h"
+
+namespace sandrokottos {
+
+// 問題のスナップショットを、バイナリ形式で読み書きします。
+// 行列の構築を省略できますし、読み込みはメモリ・マップなので、同じノードで動く複数のプロセスがページ・キャッシュを共有できます。
+//
+// 形式（整数は書き込んだマシンのバイト・オーダーで、各セクションは64バイト境界に配置します）:
+//   ヘッダー         Magic、Version、RobotSize、OrderSize
+//   Capacities       int32 × RobotSize
+//   RobotIDs         int64 × RobotSize
+//   OrderIDs         int64 × OrderSize
+//   TimeWindows      int32 × OrderSize × 2（開始、終了）
+//   Locations        int32 × OrderSize × 2 × 2（ノードごとのx、y）
+//   DistanceMatrix   int32 × (OrderSize × 2)²
+//   DurationMatrix   int32 × (OrderSize × 2)²
+
+constexpr auto SnapshotMagic = std::array<char, 8>{'S', 'N', 'D', 'R', 'K', 'T', 'S', '\0'};
+constexpr auto SnapshotVersion = std::uint32_t{1};
+
+struct SnapshotHeader final {
+  std::array<char, 8> Magic;
+  std::uint32_t Version;
+  std::uint32_t ByteOrderMark;
+  std::int32_t RobotSize;
+  std::int32_t OrderSize;
+};
+
+class SnapshotLayout final {
+  std::size_t CapacitiesOffset;
+  std::size_t RobotIDsOffset;
+  std::size_t OrderIDsOffset;
+  std::size_t TimeWindowsOffset;
+  std::size_t LocationsOffset;
+  std::size_t DistanceMatrixOffset;
+  std::size_t DurationMatrixOffset;
+  std::size_t Size;
+
+  static auto align(std::size_t Offset) noexcept {
+    return (Offset + (64 - 1)) / 64 * 64;
+  }
+
+public:
+  explicit SnapshotLayout(int RobotSize, int OrderSize) noexcept {
+    const auto NodeSize = static_cast<std::size_t>(OrderSize) * 2;
+
+    CapacitiesOffset = align(sizeof(SnapshotHeader));
+    RobotIDsOffset = align(CapacitiesOffset + sizeof(std::int32_t) * RobotSize);
+    OrderIDsOffset = align(RobotIDsOffset + sizeof(std::int64_t) * RobotSize);
+    TimeWindowsOffset = align(OrderIDsOffset + sizeof(std::int64_t) * OrderSize);
+    LocationsOffset = align(TimeWindowsOffset + sizeof(std::int32_t) * OrderSize * 2);
+    DistanceMatrixOffset = align(LocationsOffset + sizeof(std::int32_t) * NodeSize * 2);
+    DurationMatrixOffset = align(DistanceMatrixOffset + sizeof(std::int32_t) * NodeSize * NodeSize);
+    Size = DurationMatrixOffset + sizeof(std::int32_t) * NodeSize * NodeSize;
+  }
+
+  auto getCapacitiesOffset() const noexcept {
+    return CapacitiesOffset;
+  }
+
+  auto getRobotIDsOffset() const noexcept {
+    return RobotIDsOffset;
+  }
+
+  auto getOrderIDsOffset() const noexcept {
+    return OrderIDsOffset;
+  }
+
+  auto getTimeWindowsOffset() const noexcept {
+    return TimeWindowsOffset;
+  }
+
+  auto getLocationsOffset() const noexcept {
+    return LocationsOffset;
+  }
+
+  auto getDistanceMatrixOffset() const noexcept {
+    return DistanceMatrixOffset;
+  }
+
+  auto getDurationMatrixOffset() const noexcept {
+    return DurationMatrixOffset;
+  }
+
+  auto getSize() const noexcept {
+    return Size;
+  }
+};
+
+// 読み込み専用でメモリ・マップしたファイルです。
+
+class MappedFile final {
+#ifdef _WIN32
+  HANDLE File;
+  HANDLE Mapping;
+#else
+  int File;
+#endif
+  const std::byte *Data;
+  std::size_t Size;
+
+public:
+  explicit MappedFile(const std::string &Path) noexcept : Data{nullptr}, Size{0} {
+#ifdef _WIN32
+    File = CreateFileA(Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    Mapping = nullptr;
+
+    if (File == INVALID_HANDLE_VALUE) {
+      return;
+    }
+
+    auto FileSize = LARGE_INTEGER{};
+
+    if (!GetFileSizeEx(File, &FileSize) || FileSize.QuadPart == 0) {
+      return;
+    }
+
+    Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (Mapping == nullptr) {
+      return;
+    }
+
+    Data = static_cast<const std::byte *>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+    Size = Data ? static_cast<std::size_t>(FileSize.QuadPart) : 0;
+#else
+    File = open(Path.c_str(), O_RDONLY);
+
+    if (File < 0) {
+      return;
+    }
+
+    struct stat Stat {};
+
+    if (fstat(File, &Stat) != 0 || Stat.st_size == 0) {
+      return;
+    }
+
+    const auto Address = mmap(nullptr, static_cast<std::size_t>(Stat.st_size), PROT_READ, MAP_SHARED, File, 0);
+
+    if (Address == MAP_FAILED) {
+      return;
+    }
+
+    Data = static_cast<const std::byte *>(Address);
+    Size = static_cast<std::size_t>(Stat.st_size);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (Data) {
+      UnmapViewOfFile(Data);
+    }
+
+    if (Mapping) {
+      CloseHandle(Mapping);
+    }
+
+    if (File != INVALID_HANDLE_VALUE) {
+      CloseHandle(File);
+    }
+#else
+    if (Data) {
+      munmap(const_cast<std::byte *>(Data), Size);
+    }
+
+    if (File >= 0) {
+      close(File);
+    }
+#endif
+  }
+
+  auto getData() const noexcept {
+    return Data;
+  }
+
+  auto getSize() const noexcept {
+    return Size;
+  }
+};
+
+inline auto writeSnapshot(std::ostream &Stream, const Problem &Problem, const Identifiers &Identifiers) noexcept {
+  const auto Layout = SnapshotLayout{Problem.getRobotSize(), Problem.getOrderSize()};
+
+  auto Buffer = std::vector<std::byte>(Layout.getSize());
+
+  const auto Write = [&](std::size_t Offset, const auto &Values) {
+    std::memcpy(std::data(Buffer) + Offset, std::data(Values), sizeof(Values[0]) * std::size(Values));
+  };
+
+  Write(0, std::array<SnapshotHeader, 1>{SnapshotHeader{SnapshotMagic, SnapshotVersion, 0x01020304, Problem.getRobotSize(), Problem.getOrderSize()}});
+
+  Write(Layout.getCapacitiesOffset(), Problem.getCapacities());
+  Write(Layout.getRobotIDsOffset(), Identifiers.getRobotIDs());
+  Write(Layout.getOrderIDsOffset(), Identifiers.getOrderIDs());
+
+  Write(Layout.getTimeWindowsOffset(), [&] {
+    auto Result = std::vector<std::int32_t>{};
+
+    for (const auto &[Lower, Upper] : Problem.getTimeWindows()) {
+      Result.emplace_back(Lower);
+      Result.emplace_back(Upper);
+    }
+
+    return Result;
+  }());
+
+  Write(Layout.getLocationsOffset(), [&] {
+    auto Result = std::vector<std::int32_t>{};
+
+    for (const auto &[X, Y] : Problem.getLocations()) {
+      Result.emplace_back(X);
+      Result.emplace_back(Y);
+    }
+
+    return Result;
+  }());
+
+  Write(Layout.getDistanceMatrixOffset(), std::span<const int>{Problem.getDistanceMatrix().getData(), static_cast<std::size_t>(Problem.getOrderSize()) * 2 * Problem.getOrderSize() * 2});
+  Write(Layout.getDurationMatrixOffset(), std::span<const int>{Problem.getDurationMatrix().getData(), static_cast<std::size_t>(Problem.getOrderSize()) * 2 * Problem.getOrderSize() * 2});
+
+  Stream.write(reinterpret_cast<const char *>(std::data(Buffer)), static_cast<std::streamsize>(std::size(Buffer)));
+
+  return static_cast<bool>(Stream);
+}
+
+inline auto readSnapshot(const std::string &Path) noexcept {
+  using ResultType = std::optional<std::tuple<Problem, Identifiers>>;
+
+  const auto File = std::make_shared<MappedFile>(Path);
+
+  if (!File->getData() || File->getSize() < sizeof(SnapshotHeader)) {
+    std::cerr << "CAN NOT MAP SNAPSHOT..." << std::endl;
+    return ResultType{};
+  }
+
+  const auto Header = [&] {
+    auto Result = SnapshotHeader{};
+
+    std::memcpy(&Result, File->getData(), sizeof(Result));
+
+    return Result;
+  }();
+
+  if (Header.Magic != SnapshotMagic || Header.Version != SnapshotVersion || Header.ByteOrderMark != 0x01020304) {
+    std::cerr << "INVALID SNAPSHOT..." << std::endl;
+    return ResultType{};
+  }
+
+  // 壊れたファイルで巨大なメモリを確保したりオフセットが桁あふれしたりしないように、レイアウトを計算する前に大きさを確認します。
+  // 注文の数の上限は、readProblemが読み込む注文の数と同じです。ロボットの数には上限がないので、ロボットのセクションがファイルに収まる数までにします。
+
+  if (Header.RobotSize < 0 || static_cast<std::size_t>(Header.RobotSize) > File->getSize() / (sizeof(std::int32_t) + sizeof(std::int64_t)) || Header.OrderSize < 0 || Header.OrderSize > MaxOrderSize) {
+    std::cerr << "INVALID SNAPSHOT..." << std::endl;
+    return ResultType{};
+  }
+
+  const auto Layout = SnapshotLayout{Header.RobotSize, Header.OrderSize};
+
+  if (File->getSize() < Layout.getSize()) {
+    std::cerr << "TRUNCATED SNAPSHOT..." << std::endl;
+    return ResultType{};
+  }
+
+  // 小さなセクションはコピーして、行列はメモリ・マップした領域をそのまま使用します。
+
+  const auto Read = [&]<typename T>(std::size_t Offset, std::size_t Size) {
+    auto Result = std::vector<T>(Size);
+
+    std::memcpy(std::data(Result), File->getData() + Offset, sizeof(T) * Size);
+
+    return Result;
+  };
+
+  const auto Capacities = Read.template operator()<int>(Layout.getCapacitiesOffset(), Header.RobotSize);
+  const auto RobotIDs = Read.template operator()<std::int64_t>(Layout.getRobotIDsOffset(), Header.RobotSize);
+  const auto OrderIDs = Read.template operator()<std::int64_t>(Layout.getOrderIDsOffset(), Header.OrderSize);
+
+  const auto TimeWindows = [&] {
+    const auto Values = Read.template operator()<int>(Layout.getTimeWindowsOffset(), static_cast<std::size_t>(Header.OrderSize) * 2);
+
+    auto Result = std::vector<std::tuple<int, int>>{};
+
+    for (const auto &I : std::views::iota(0, Header.OrderSize)) {
+      Result.emplace_back(Values[I * 2 + 0], Values[I * 2 + 1]);
+    }
+
+    return Result;
+  }();
+
+  const auto Locations = [&] {
+    const auto Values = Read.template operator()<int>(Layout.getLocationsOffset(), static_cast<std::size_t>(Header.OrderSize) * 2 * 2);
+
+    auto Result = std::vector<std::tuple<int, int>>{};
+
+    for (const auto &I : std::views::iota(0, Header.OrderSize * 2)) {
+      Result.emplace_back(Values[I * 2 + 0], Values[I * 2 + 1]);
+    }
+
+    return Result;
+  }();
+
+  const auto DistanceMatrix = Matrix{Header.OrderSize * 2, std::shared_ptr<const int[]>{File, reinterpret_cast<const int *>(File->getData() + Layout.getDistanceMatrixOffset())}};
+  const auto DurationMatrix = Matrix{Header.OrderSize * 2, std::shared_ptr<const int[]>{File, reinterpret_cast<const int *>(File->getData() + Layout.getDurationMatrixOffset())}};
+
+  return ResultType{std::in_place, Problem{Header.RobotSize, Header.OrderSize, Capacities, TimeWindows, Locations, DistanceMatrix, DurationMatrix}, Identifiers{RobotIDs, OrderIDs}};
+}
+
+} // namespace sandrokottos
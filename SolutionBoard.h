@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "Model.h"
+
+namespace sandrokottos {
+
+// スレッド間で、それまでに見つかった最良のソリューションを共有します。
+// ソリューションは変更できない値として共有して、ポインターの差し替えだけで公開するので、読み込む側がロックで待たされることはありません。
+
+class SolutionBoard final {
+  std::atomic<std::shared_ptr<const Solution>> Best;
+  std::atomic<int> Version;
+
+public:
+  SolutionBoard() noexcept : Best{}, Version{0} {}
+
+  // 最良のソリューションよりコストが小さい場合だけ公開します。公開した場合はtrueをリターンします。
+
+  auto publish(const Solution &Solution) noexcept {
+    const auto NewBest = std::make_shared<const sandrokottos::Solution>(Solution);
+
+    auto Current = Best.load();
+
+    do {
+      if (Current && !(NewBest->getCost() < Current->getCost())) {
+        return false;
+      }
+    } while (!Best.compare_exchange_weak(Current, NewBest));
+
+    Version++;
+
+    return true;
+  }
+
+  // 最良のソリューションをリターンします。まだ公開されていない場合は、nullptrをリターンします。
+
+  auto get() const noexcept {
+    return Best.load();
+  }
+
+  // 公開するたびに増える値です。前回と比較して、新しいソリューションが公開されたかを判断してください。
+
+  auto getVersion() const noexcept {
+    return Version.load();
+  }
+};
+
+} // namespace sandrokottos
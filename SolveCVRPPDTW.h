@@ -1,10 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <iterator>
 #include <ranges>
+#include <tuple>
 #include <vector>
 
 #include <ortools/constraint_solver/routing.h>
@@ -12,24 +16,187 @@
 #include <ortools/constraint_solver/routing_index_manager.h>
 #include <ortools/constraint_solver/routing_parameters.h>
 
+#include "CalculateLowerBound.h"
+#include "Executor.h"
 #include "Model.h"
+#include "SolutionBoard.h"
 
 namespace sandrokottos {
 
+// ルーティングのモデルのコストです。
+//
+//   Distance: 総走行距離だけをコストにします。希望配送時間は、制約として扱います。
+//   Score:    配送件数のスコア（Score1）と荷物を積んでいる時間（Score2）も、重みを付けてコストに含めます。希望配送時間から外れた配送も許すので、部分点の注文も経路に含められます。
+
+enum class RoutingObjective { Distance, Score };
+
 // OR-Toolsを使用して、Constrained Vehicle Routing Problem with Pickup and Delivery with Time Windowsを解きます。
+// 探索の途中で見つかったソリューションは、後の処理が探索と並行して使えるように、SolutionBoardに公開します。
+// RoutingObjective::Distanceの場合は、単独でも希望配送時間に間に合わない注文はモデルに含めずに、部分点を狙う後の処理（OptimizeOrderSize）に任せます。
 
 class SolveCVRPPDTW final {
   const sandrokottos::Problem &Problem;
   const operations_research::RoutingSearchParameters &RoutingSearchParameters;
+  SolutionBoard &Board;
+  RoutingObjective Objective;
 
-public:
-  explicit SolveCVRPPDTW(const sandrokottos::Problem &Problem, const operations_research::RoutingSearchParameters &RoutingSearchParameters) noexcept
-      : Problem{Problem}, RoutingSearchParameters{RoutingSearchParameters} {}
+  // RoutingObjective::Scoreの場合の、スコアごとの重みです。Score1を最優先するように、1点あたりの重みを大きくしています。
+
+  static constexpr auto Score1Weight = 1'000;
+  static constexpr auto Score2Weight = 10;
+
+  // ノードを訪問しない場合のペナルティです。RoutingObjective::Scoreの場合は、注文の2つのノードで、配送件数のスコアの満点分になります。
+  // 希望配送時刻から外れた場合のコストは最大でも60点分（getDeliveryRangeを参照）なので、部分点でも配送した方がコストが小さくなります。
+
+  auto getPenalty() const noexcept {
+    return Objective == RoutingObjective::Score ? Score1Weight * 100 / 2 : 300;
+  }
+
+  // モデルに含めるノードです。モデルのノードのインデックスから、問題のノードに変換するために使用します。最後のノードは、出発地点です。
+
+  std::vector<int> Nodes;
+
+  auto getDepot() const noexcept {
+    return static_cast<int>(std::size(Nodes));
+  }
+
+  static auto getNodes(const sandrokottos::Problem &Problem, RoutingObjective Objective) noexcept {
+    const auto MaxScore1s = CalculateLowerBound{Problem}.getMaxScore1s();
+
+    auto Result = std::vector<int>{};
+
+    for (const auto &I : std::views::iota(0, Problem.getOrderSize())) {
+      if (MaxScore1s[I] < (Objective == RoutingObjective::Score ? 1 : 100)) {
+        continue;
+      }
+
+      Result.emplace_back(I * 2 + 0);
+      Result.emplace_back(I * 2 + 1);
+    }
+
+    return Result;
+  }
+
+  // モデルに含めるロボットです。モデルの車両のインデックスから、問題のロボットに変換するために使用します。
+  // キャパシティーが同じロボットは区別できないので、キャパシティーが大きい順に、必要な台数だけをモデルに含めます。
+
+  std::vector<int> Robots;
+
+  static auto getRobots(const sandrokottos::Problem &Problem) noexcept {
+    auto Result = std::vector<int>{};
+
+    std::ranges::copy(std::views::iota(0, Problem.getRobotSize()), std::back_inserter(Result));
+
+    std::ranges::stable_sort(Result, std::greater<>{}, [&](const auto &I) {
+      return Problem.getCapacities()[I];
+    });
+
+    return Result;
+  }
+
+  // 必要なロボットの台数の見積もりです。ノードごとの入ってくる辺の最短の移動時間の合計（稼働時間の下界）を、1台あたりの稼働時間で割った台数の2倍にします。
+
+  auto getFleetSize() const noexcept {
+    auto Duration = 0;
+
+    for (const auto &MinDuration : CalculateLowerBound{Problem}.getMinDurations(Nodes)) {
+      Duration += MinDuration;
+    }
+
+    return std::clamp((Duration + (150 - 2) - 1) / (150 - 2) * 2, 1, Problem.getRobotSize());
+  }
+
+  // モデルの注文（I番目）の、配送時刻の範囲です。
+  // RoutingObjective::Scoreの場合は、希望配送時刻から60分（配送件数のスコアが下限の20点になるまで）外れるところまで許します。
+
+  auto getDeliveryRange(int I) const noexcept {
+    const auto &[Lower, Upper] = Problem.getTimeWindows()[Nodes[I * 2 + 1] / 2];
+
+    if (Objective == RoutingObjective::Score) {
+      return std::make_tuple(std::max(Lower - 60, 30), std::min(Upper + 60, 150 - 2));
+    }
+
+    return std::make_tuple(std::max(Lower, 30), std::min(Upper, 150 - 2));
+  }
 
-  auto operator()(const std::chrono::steady_clock::time_point &TimeLimit) const noexcept {
-    auto RoutingManager = operations_research::RoutingIndexManager{Problem.getOrderSize() * 2 + 1,
-                                                                   Problem.getRobotSize(),
-                                                                   operations_research::RoutingIndexManager::NodeIndex{Problem.getOrderSize() * 2}};
+  // ロボットを増やせば、訪問しないノードを減らせるかを判定します。
+  // モデルのロボットがすべて使われていて、訪問しない注文の中に、使っていないロボット1台だけで配送できる注文がある場合だけ、trueをリターンします。
+  // RoutingObjective::Scoreの場合は、訪問しないこと自体がコストの最適解になり得るので、訪問しないノードがあるだけではロボットを増やしません。
+
+  auto isGrowable(int FleetSize, const std::vector<Route> &Routes) const noexcept {
+    if (FleetSize == Problem.getRobotSize() || Problem.getCapacities()[Robots[FleetSize]] < 1) {
+      return false;
+    }
+
+    if (std::ranges::any_of(Robots | std::views::take(FleetSize), [&](const auto &I) { return Routes[I].empty(); })) {
+      return false;
+    }
+
+    auto IsVisited = std::vector<bool>(Problem.getOrderSize() * 2, false);
+
+    for (const auto &Route : Routes) {
+      for (const auto &Node : Route) {
+        IsVisited[Node] = true;
+      }
+    }
+
+    return std::ranges::any_of(std::views::iota(0, getDepot() / 2), [&](const auto &I) {
+      return !IsVisited[Nodes[I * 2 + 0]] && Problem.getDurationMatrix()[Nodes[I * 2 + 0]][Nodes[I * 2 + 1]] <= std::get<1>(getDeliveryRange(I));
+    });
+  }
+
+  // NextIndexで次のインデックスを求めながら、経路をたどります。経路は、問題のロボットごとに作成します。
+
+  template <typename F>
+  auto getRoutes(const operations_research::RoutingIndexManager &RoutingManager, const operations_research::RoutingModel &RoutingModel, F &&NextIndex) const noexcept {
+    auto Result = std::vector<Route>(Problem.getRobotSize());
+
+    for (const auto &I : std::views::iota(0, RoutingModel.vehicles())) {
+      auto &Route = Result[Robots[I]];
+
+      auto Index = RoutingModel.Start(I);
+
+      if (!RoutingModel.IsEnd(Index)) {
+        for (Index = NextIndex(Index); !RoutingModel.IsEnd(Index); Index = NextIndex(Index)) {
+          Route.emplace_back(Nodes[RoutingManager.IndexToNode(Index).value()]);
+        }
+      }
+    }
+
+    return Result;
+  }
+
+  // 下のモデルのコスト（総走行距離と、訪問しないノードのペナルティの合計）の下界です。
+  // ノードごとに、入ってくる辺の最短距離かペナルティのどちらか小さい方がかかります。ただし、経路の最初のノードには辺が入ってこないので、大きい方からロボットの台数分を除きます。
+  // RoutingObjective::Scoreの場合の希望配送時刻と稼働時間のコストは0以上なので、無視しても下界になります。
+
+  auto getCostLowerBound() const noexcept {
+    auto Result = std::int64_t{0};
+
+    auto Distances = CalculateLowerBound{Problem}.getMinDistances(Nodes);
+
+    for (auto &Distance : Distances) {
+      Distance = std::min(Distance, getPenalty());
+    }
+
+    std::ranges::sort(Distances);
+
+    for (const auto &Distance : Distances | std::views::take(std::max(static_cast<int>(std::size(Distances)) - Problem.getRobotSize(), 0))) {
+      Result += Distance;
+    }
+
+    return Result;
+  }
+
+  // FleetSize台のロボットで解いて、問題のロボットごとの経路と、ロボットを増やして解き直すべきか（isGrowable）をリターンします。InitialRoutesに経路がある場合は、そこから探索を始めます。
+  // 制限時間の半分を過ぎてもisGrowableなら、ロボットを増やして解き直すために探索を打ち切ります。
+
+  auto solve(int FleetSize, const std::vector<Route> &InitialRoutes, const std::shared_future<std::int64_t> &CostLowerBoundFuture, const std::chrono::steady_clock::time_point &TimeLimit) const noexcept {
+    const auto GrowingTime = FleetSize < Problem.getRobotSize() ? std::chrono::steady_clock::now() + (TimeLimit - std::chrono::steady_clock::now()) / 2 : std::chrono::steady_clock::time_point::max();
+
+    auto RoutingManager = operations_research::RoutingIndexManager{getDepot() + 1,
+                                                                   FleetSize,
+                                                                   operations_research::RoutingIndexManager::NodeIndex{getDepot()}};
 
     auto RoutingModel = operations_research::RoutingModel{RoutingManager};
 
@@ -39,17 +206,17 @@ public:
       const auto FromNode = RoutingManager.IndexToNode(FromIndex).value();
       const auto ToNode = RoutingManager.IndexToNode(ToIndex).value();
 
-      if (FromNode == Problem.getOrderSize() * 2 || ToNode == Problem.getOrderSize() * 2) {
+      if (FromNode == getDepot() || ToNode == getDepot()) {
         return 0;
       }
 
-      return Problem.getDistanceMatrix()[FromNode][ToNode];
+      return Problem.getDistanceMatrix()[Nodes[FromNode]][Nodes[ToNode]];
     }));
 
     // ノードを訪問しない場合のペナルティを設定します。
 
-    for (const auto &I : std::views::iota(0, Problem.getOrderSize() * 2)) {
-      RoutingModel.AddDisjunction({RoutingManager.NodeToIndex(operations_research::RoutingIndexManager::NodeIndex{I})}, 300);
+    for (const auto &I : std::views::iota(0, getDepot())) {
+      RoutingModel.AddDisjunction({RoutingManager.NodeToIndex(operations_research::RoutingIndexManager::NodeIndex{I})}, getPenalty());
     }
 
     // 荷物の量がキャパシティを超えてはなりません。
@@ -58,20 +225,30 @@ public:
         RoutingModel.RegisterUnaryTransitCallback([&](const auto &Index) {
           const auto Node = RoutingManager.IndexToNode(Index).value();
 
-          if (Node == Problem.getOrderSize() * 2) {
+          if (Node == getDepot()) {
             return 0;
           }
 
-          return Node % 2 == 0 ? 1 : -1;
+          return Nodes[Node] % 2 == 0 ? 1 : -1;
         }),
         0,
-        std::vector<std::int64_t>(std::begin(Problem.getCapacities()), std::end(Problem.getCapacities())),
+        [&] {
+          auto Result = std::vector<std::int64_t>{};
+
+          std::ranges::copy(
+              Robots | std::views::take(FleetSize) | std::views::transform([&](const auto &I) {
+                return static_cast<std::int64_t>(Problem.getCapacities()[I]);
+              }),
+              std::back_inserter(Result));
+
+          return Result;
+        }(),
         true,
         "Capacity");
 
     // 注文単位で、積込みの後に配送をしなければなりません。
 
-    for (const auto &I : std::views::iota(0, Problem.getOrderSize())) {
+    for (const auto &I : std::views::iota(0, getDepot() / 2)) {
       RoutingModel.AddPickupAndDelivery(RoutingManager.NodeToIndex(operations_research::RoutingIndexManager::NodeIndex{I * 2 + 0}),
                                         RoutingManager.NodeToIndex(operations_research::RoutingIndexManager::NodeIndex{I * 2 + 1}));
     }
@@ -83,11 +260,11 @@ public:
           const auto FromNode = RoutingManager.IndexToNode(FromIndex).value();
           const auto ToNode = RoutingManager.IndexToNode(ToIndex).value();
 
-          if (FromNode == Problem.getOrderSize() * 2 || ToNode == Problem.getOrderSize() * 2) {
+          if (FromNode == getDepot() || ToNode == getDepot()) {
             return 0;
           }
 
-          return Problem.getDurationMatrix()[FromNode][ToNode];
+          return Problem.getDurationMatrix()[Nodes[FromNode]][Nodes[ToNode]];
         }),
         150 - 2,
         150 - 2,
@@ -96,14 +273,31 @@ public:
 
     // 時刻はこの先の処理で必要となるので、変数に対比しておきます。
 
-    const auto &TimeDimension = RoutingModel.GetDimensionOrDie("Time");
+    auto &TimeDimension = *RoutingModel.GetMutableDimension("Time");
 
-    // 希望配送時刻に配送しなければなりません。
+    // 配送時刻の範囲内に配送しなければなりません。
 
-    for (const auto &I : std::views::iota(0, Problem.getOrderSize())) {
+    for (const auto &I : std::views::iota(0, getDepot() / 2)) {
       auto DeriveryTime = TimeDimension.CumulVar(RoutingManager.NodeToIndex(operations_research::RoutingIndexManager::NodeIndex{I * 2 + 1}));
 
-      DeriveryTime->SetRange(std::max(std::get<0>(Problem.getTimeWindows()[I]), 30), std::min(std::get<1>(Problem.getTimeWindows()[I]), 150 - 2));
+      DeriveryTime->SetRange(std::get<0>(getDeliveryRange(I)), std::get<1>(getDeliveryRange(I)));
+    }
+
+    // RoutingObjective::Scoreの場合は、希望配送時刻から外れた分をコストにします。
+    // 実際のスコアは外れると20点減ってから1分ごとに1点減りますが、1分ごとの1点（Score1Weight）だけを線形のコストにして、最初の20点の段差はCP-SATでタイムテーブルを作成する際に扱います。
+    // 外れるのは最大60分なので、このコストはノードを訪問しない場合のペナルティより小さくなります。
+    // 荷物を積んでいる時間は、ロボットの稼働時間（待ち時間を含みます）で近似します。
+
+    if (Objective == RoutingObjective::Score) {
+      for (const auto &I : std::views::iota(0, getDepot() / 2)) {
+        const auto Index = RoutingManager.NodeToIndex(operations_research::RoutingIndexManager::NodeIndex{I * 2 + 1});
+        const auto &[Lower, Upper] = Problem.getTimeWindows()[Nodes[I * 2 + 1] / 2];
+
+        TimeDimension.SetCumulVarSoftLowerBound(Index, Lower, Score1Weight);
+        TimeDimension.SetCumulVarSoftUpperBound(Index, Upper, Score1Weight);
+      }
+
+      TimeDimension.SetSpanCostCoefficientForAllVehicles(Score2Weight);
     }
 
     /* 時刻は制約プログラミングで設定するので、ここでは何もしません。
@@ -115,9 +309,51 @@ public:
     }
     */
 
+    // コストが下界に達したら、それ以上は改善できないので探索を打ち切ります。
+
+    const auto CostLowerBound = getExecutor().get(CostLowerBoundFuture);
+
+    auto IsOptimal = false;
+
+    RoutingModel.AddAtSolutionCallback([&] {
+      if (RoutingModel.CostVar()->Value() <= CostLowerBound) {
+        IsOptimal = true;
+      }
+    });
+
+    // 見つかったソリューションを公開して、ロボットを増やすべきかを記録します。探索を止めないように、タイムテーブルはCP-SATを使わずに作成します。
+
+    auto IsGrowable = false;
+
+    RoutingModel.AddAtSolutionCallback([&] {
+      const auto Routes = getRoutes(RoutingManager, RoutingModel, [&](const auto &Index) {
+        return RoutingModel.NextVar(Index)->Value();
+      });
+
+      const auto Timetables = [&] {
+        auto Result = std::vector<Timetable>{};
+
+        std::ranges::copy(
+            Routes | std::views::transform([&](const auto &Route) {
+              return CreateEarliestTimetable{Problem}(Route);
+            }),
+            std::back_inserter(Result));
+
+        return Result;
+      }();
+
+      Board.publish(Solution{Routes, Timetables, CalculateCost{Problem}(Routes, Timetables)});
+
+      IsGrowable = isGrowable(FleetSize, Routes);
+    });
+
+    RoutingModel.AddSearchMonitor(RoutingModel.solver()->MakeCustomLimit([&] {
+      return IsOptimal || (IsGrowable && std::chrono::steady_clock::now() >= GrowingTime);
+    }));
+
     // 問題を解きます。
 
-    const auto RoutingSolution = RoutingModel.SolveWithParameters([&] {
+    const auto Parameters = [&] {
       auto Result = RoutingSearchParameters;
 
       const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(TimeLimit - std::chrono::steady_clock::now()).count();
@@ -126,46 +362,102 @@ public:
       Result.mutable_time_limit()->set_nanos(static_cast<int>(duration % 1'000'000'000));
 
       return Result;
-    }());
-
-    // ソリューションを作成してリターンします。
-
-    return [&] {
-      const auto Routes = [&] {
-        auto Result = std::vector<Route>{};
+    }();
 
-        for (const auto &I : std::views::iota(0, Problem.getRobotSize())) {
-          Result.emplace_back([&] {
-            auto Result = Route{};
+    // 前回の経路がある場合は、モデルの車両とノードのインデックスに変換して、初期解にします。
 
-            auto Index = RoutingModel.Start(I);
+    const auto InitialAssignment = [&]() -> const operations_research::Assignment * {
+      if (std::ranges::all_of(InitialRoutes, [](const auto &Route) { return Route.empty(); })) {
+        return nullptr;
+      }
 
-            if (!RoutingModel.IsEnd(Index)) {
-              for (Index = RoutingSolution->Value(RoutingModel.NextVar(Index)); !RoutingModel.IsEnd(Index); Index = RoutingSolution->Value(RoutingModel.NextVar(Index))) {
-                Result.emplace_back(RoutingManager.IndexToNode(Index).value());
-              }
-            }
+      const auto ModelNodes = [&] {
+        auto Result = std::vector<int>(Problem.getOrderSize() * 2, -1);
 
-            return Result;
-          }());
+        for (const auto &I : std::views::iota(0, getDepot())) {
+          Result[Nodes[I]] = I;
         }
 
         return Result;
       }();
 
-      const auto Timetables = [&] {
-        auto Result = std::vector<Timetable>{};
+      auto Routes = std::vector<std::vector<std::int64_t>>{};
 
-        std::ranges::copy(
-            Routes | std::views::transform([&](const auto &Route) {
-              return CreateStrictTimetable{Problem}(Route);
-            }),
-            std::back_inserter(Result));
+      for (const auto &I : Robots | std::views::take(FleetSize)) {
+        Routes.emplace_back();
 
-        return Result;
-      }();
+        for (const auto &Node : InitialRoutes[I]) {
+          Routes.back().emplace_back(RoutingManager.NodeToIndex(operations_research::RoutingIndexManager::NodeIndex{ModelNodes[Node]}));
+        }
+      }
+
+      RoutingModel.CloseModelWithParameters(Parameters);
+
+      return RoutingModel.ReadAssignmentFromRoutes(Routes, true);
+    }();
+
+    const auto RoutingSolution = InitialAssignment ? RoutingModel.SolveFromAssignmentWithParameters(InitialAssignment, Parameters) : RoutingModel.SolveWithParameters(Parameters);
+
+    // 解が見つからなかった場合は、前回の経路をリターンします。
+
+    if (!RoutingSolution) {
+      return std::make_tuple(InitialRoutes, false);
+    }
+
+    const auto Routes = getRoutes(RoutingManager, RoutingModel, [&](const auto &Index) {
+      return RoutingSolution->Value(RoutingModel.NextVar(Index));
+    });
+
+    return std::make_tuple(Routes, isGrowable(FleetSize, Routes));
+  }
+
+public:
+  explicit SolveCVRPPDTW(const sandrokottos::Problem &Problem, const operations_research::RoutingSearchParameters &RoutingSearchParameters, SolutionBoard &Board, RoutingObjective Objective = RoutingObjective::Distance) noexcept
+      : Problem{Problem}, RoutingSearchParameters{RoutingSearchParameters}, Board{Board}, Objective{Objective}, Nodes{getNodes(Problem, Objective)}, Robots{getRobots(Problem)} {}
+
+  auto operator()(const std::chrono::steady_clock::time_point &TimeLimit, const std::chrono::steady_clock::time_point &Deadline) const noexcept {
+    // コストの下界の計算にはノード数の2乗の時間がかかるので、モデルの構築と並行して計算します。
+
+    const auto CostLowerBoundFuture = std::shared_future{getExecutor().submit([&] {
+      return getCostLowerBound();
+    })};
+
+    // 見積もった台数のロボットで解き始めて、ロボットを増やせば訪問しないノードを減らせる場合は、台数を倍にして、前回の経路から解き直します。
 
-      return Solution{Routes, Timetables, CalculateCost{Problem}(Routes, Timetables)};
+    const auto Routes = [&] {
+      auto Result = std::vector<Route>(Problem.getRobotSize());
+
+      for (auto FleetSize = getFleetSize();; FleetSize = std::min(FleetSize * 2, Problem.getRobotSize())) {
+        const auto [Routes, IsGrowable] = solve(FleetSize, Result, CostLowerBoundFuture, TimeLimit);
+
+        Result = Routes;
+
+        if (!IsGrowable || std::chrono::steady_clock::now() >= TimeLimit) {
+          break;
+        }
+      }
+
+      return Result;
+    }();
+
+    // ソリューションを作成してリターンします。
+
+    return [&] {
+      // RoutingObjective::Scoreの場合は、希望配送時刻から外れた配送を含むので、部分点を許すタイムテーブルにします。
+
+      const auto Timetables = getExecutor().map(static_cast<int>(std::size(Routes)), [&](const auto &I) {
+        if (Objective == RoutingObjective::Score) {
+          return CreateRelaxedTimetable{Problem, Deadline}(Routes[I]);
+        }
+
+        return CreateStrictTimetable{Problem, Deadline}(Routes[I]);
+      });
+
+      const auto Result = Solution{Routes, Timetables, CalculateCost{Problem}(Routes, Timetables)};
+
+      Board.publish(Result);
+
+      return Result;
     }();
   }
 };